@@ -1,7 +1,12 @@
 #pragma once
 
 #include "ModelLoader.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <climits>
 #include <functional>
 #include <fwd.hpp> //GLM
 #include <vector>
@@ -25,12 +30,41 @@ public:
     {
     }
 
+    // inverted box, any surrounding() call makes it valid
+    static AABB empty()
+    {
+        return AABB(glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX));
+    }
+
     void surrounding(AABB const& aabb)
     {
         min = glm::min(min, aabb.min);
         max = glm::max(max, aabb.max);
     }
 
+    void surrounding(glm::vec3 const& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    bool isValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+
+    // intersection with other box, result may be empty (min > max)
+    void clip(AABB const& aabb)
+    {
+        min = glm::max(min, aabb.min);
+        max = glm::min(max, aabb.max);
+    }
+
+    float surfaceArea() const
+    {
+        glm::vec3 d = max - min;
+        if (d.x < 0 || d.y < 0 || d.z < 0)
+            return 0.0f;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
     bool rayIntersect(glm::vec3& origin, glm::vec3& direction, float& mint)
     {
         if (glm::all(glm::greaterThan(origin, this->min)) && glm::all(glm::lessThan(origin, this->max)))
@@ -52,80 +86,203 @@ public:
     const glm::vec3& getMax() const { return max; }
 };
 
-struct Triangle {
-private:
-    glm::vec3 vertex1;
-    glm::vec3 vertex2;
-    glm::vec3 vertex3;
-    int index;
-    glm::vec3 center;
+// triangle and the part of its bound box that belongs to one node,
+// spatial splits duplicate triangles into several clipped references
+struct TriangleReference {
+    int triangle;
     AABB aabb;
+};
 
-public:
-    Triangle(glm::vec3 vertex1, glm::vec3 vertex2, glm::vec3 vertex3,
-        int index, glm::ivec3 triIndex)
-        : vertex1(vertex1)
-        , vertex2(vertex2)
-        , vertex3(vertex3)
-        , index(index)
+// inner node: leftChild, rightChild - node indices (always > 0, root is never a child)
+// leaf: leftChild - first triangle in BVHBuilder::getTriangleIndices(), rightChild - minus triangle count
+struct Node {
+    int leftChild, rightChild;
+    AABB aabb;
+
+    Node()
+        : leftChild(0)
+        , rightChild(0)
+        , aabb(glm::vec3(0), glm::vec3(0))
     {
-        aabb = genAABB();
-        center = genCenter();
+        constexpr int size = sizeof(*this) / sizeof(float);
     }
 
-    Triangle()
-        : Triangle(glm::vec3(0, 0, 0), glm::vec3(0, 0, 0),
-            glm::vec3(0, 0, 0), 0, glm::ivec3(0)) {};
+    bool isLeaf() const { return rightChild < 0; }
+    int triangleOffset() const { return leftChild; }
+    int triangleCount() const { return -rightChild; }
 
-    glm::vec3& getCenter() { return center; }
-    AABB& getAABB() { return aabb; }
-    int getIndex() { return index; }
+    void setLeaf(int offset, int count)
+    {
+        leftChild = offset;
+        rightChild = -count;
+    }
+};
 
-    glm::vec3 getCenter() const { return center; }
-    AABB getAABB() const { return aabb; }
-    int getIndex() const { return index; }
+// half-open range of changed elements, for partial texture uploads
+struct DirtyRange {
+    int begin = INT_MAX;
+    int end = 0;
 
-private:
-    glm::vec3 genCenter()
+    DirtyRange() = default;
+    DirtyRange(int begin, int end)
+        : begin(begin)
+        , end(end)
     {
-        glm::vec3 sum = vertex1 + vertex2 + vertex3;
-        glm::vec3 centerDim = sum / 3.0f;
-        return centerDim;
     }
 
-    AABB genAABB()
+    void include(int index)
     {
-        return AABB(
-            glm::min(glm::min(vertex1, vertex2), vertex3),
-            glm::max(glm::max(vertex1, vertex2), vertex3));
+        begin = std::min(begin, index);
+        end = std::max(end, index + 1);
     }
-};
-
-struct Node {
-    int leftChild, rightChild;
-    AABB aabb;
 
-    Node()
-        : leftChild(0)
-        , rightChild(0)
-        , aabb(glm::vec3(0), glm::vec3(0))
+    void include(DirtyRange const& range)
     {
-        constexpr int size = sizeof(*this) / sizeof(float);
+        begin = std::min(begin, range.begin);
+        end = std::max(end, range.end);
     }
+
+    bool isEmpty() const { return begin >= end; }
+};
+
+enum class BVHSplitMethod {
+    Midpoint, // mean of centroids along the longest axis, fast but overlapping nodes
+    BinnedSAH, // surface area heuristic evaluated on centroid bins
+    LBVH, // linear BVH: split at the highest differing bit of sorted Morton codes, fastest build
+    SBVH, // binned SAH plus spatial splits, triangles may be referenced by several leaves
+    PLOC // bottom-up merging of nearest Morton neighbors, near SAH quality at near LBVH build time
+};
+
+struct BVHBuildSettings {
+    BVHSplitMethod splitMethod = BVHSplitMethod::BinnedSAH;
+    int sahBinCount = 16;
+    float traversalCost = 1.0f; // cost of visiting a node (box test)
+    float intersectionCost = 1.0f; // cost of one ray-triangle test
+    int mortonBits = 30; // LBVH code size, 30 (10 bits per axis) or 63 (21 bits per axis)
+    int maxLeafSize = 4; // triangles per leaf, SAH may stop splitting earlier
+
+    // PLOC only: clusters searched on each side in Morton order, bigger is slower and closer to SAH
+    int plocRadius = 16;
+
+    // SBVH only: extra references allowed, as a fraction of triangle count (memory budget)
+    float spatialSplitBudget = 0.3f;
+    // SBVH only: try spatial split if object split children overlap more than this part of root area
+    float spatialSplitAlpha = 1e-5f;
+
+    int threadCount = 0; // 0 - all hardware threads
+    bool deterministic = false; // renumber nodes depth-first, so output does not depend on scheduling
+};
+
+// wall time of the last build() per phase, milliseconds
+struct BVHBuildTimings {
+    double bounds = 0.0; // triangle bounds and centers
+    double sort = 0.0; // LBVH and PLOC Morton codes and their sort
+    double hierarchy = 0.0; // node construction
+    double reorder = 0.0; // depth-first renumbering, deterministic builds only
+    double total = 0.0;
 };
 
 struct Node;
 class BVHBuilder {
 public:
     BVHBuilder();
+    BVHBuilder(BVHBuildSettings const& settings);
     void build(const Model3D& model);
 
+    // Builds over arbitrary primitives given by bound boxes (instances of a two-level scene),
+    // getTriangleIndices() then lists primitive indices. SBVH needs triangles, it falls back to binned SAH here.
+    // refit() is for triangle trees only
+    void build(const std::vector<AABB>& primitiveBounds);
+
+    // Recompute node bounds from new vertex positions, topology is kept.
+    // Model must have the same triangles as in build(), returns range of nodes whose bounds changed.
+    // SBVH leaves get whole triangle bounds back, tree stays correct but loses spatial split gains
+    DirtyRange refit(const Model3D& model);
+
+    // Ray density around every primitive (by triangle index), binned SAH then weights the area of a node
+    // by the density of its primitives: cost = SA(L) * W(L) + SA(R) * W(R) instead of SA * N.
+    // Empty or not matching the primitive count of a build - plain SAH. Kept for later builds, see RayDistribution
+    void setTriangleWeights(std::vector<float> weights) { triangleWeights = std::move(weights); }
+    const std::vector<float>& getTriangleWeights() const { return triangleWeights; }
+
     const std::vector<Node>& getNodes() const { return nodeList; }
 
+    // triangle order of leaves, every leaf references a contiguous range of it,
+    // with SBVH a triangle may be listed several times
+    const std::vector<int>& getTriangleIndices() const { return triangleIndices; }
+    const BVHBuildSettings& getSettings() const { return settings; }
+    const BVHBuildTimings& getBuildTimings() const { return buildTimings; }
+
+    // triangle references per triangle, 1 without spatial splits
+    float getDuplicationFactor() const;
+
+    // Expected cost of a random ray hitting the root box:
+    // (sum of Ct * SA(inner node) + sum of Ci * triangle count * SA(leaf)) / SA(root)
+    float computeSAHCost() const;
+
 private:
-    void buildRecurcive(int nodeIndex, std::vector<Triangle> const& vecTriangle);
+    friend class BVHOptimizer; // rewires nodeList after build
+    friend class BVHCache; // restores nodeList and triangleIndices without a build
+    friend class BVHEditor; // inserts and removes leaves in place
+
+    // common part of both build() variants, triangleBounds and triangleCenters are ready,
+    // model is needed by spatial splits only
+    void buildHierarchy(const Model3D* model, double boundsMilliseconds);
+
+    // builds node for triangleIndices[begin, end), partitions the range in place,
+    // big subranges are built as tasks of threadPool
+    void buildRecurcive(int nodeIndex, int begin, int end);
+
+    // return false if no split is better than putting everything to one side,
+    // splitCost is SA(L) * N(L) + SA(R) * N(R) of the best split,
+    // with triangle weights SA(L) * W(L) + SA(R) * W(R) scaled by N / W(parent), so it compares to SA(parent) * N alike
+    bool findBinnedSAHSplit(int begin, int end, AABB const& centroidBounds,
+        int& axis, int& splitBin, float& splitCost) const;
+
+    // sorts triangleIndices by Morton code of triangle centers, fills mortonCodes
+    void sortByMortonCode(AABB const& centroidBounds);
+
+    // builds hierarchy from sorted codes in [begin, end), returns bound box of the subtree
+    AABB buildMortonRecursive(int nodeIndex, int begin, int end);
 
-    int texSize;
+    // PLOC (Meister and Bittner 2018): every sorted triangle starts as a cluster, each iteration finds
+    // the nearest cluster (smallest union area) within settings.plocRadius in parallel and merges mutual pairs,
+    // inner nodes are allocated from the back, so the last merge becomes the root. Leaves hold one triangle
+    void buildPLOC();
+
+    // merges subtrees of up to settings.maxLeafSize triangles into leaves where that lowers SAH cost,
+    // renumbers nodes depth-first and compacts leaf triangle ranges on the way.
+    // Children must have higher indices than their parents
+    void collapseLeaves();
+
+    // SBVH: builds node for refs, which is consumed (children get their own reference lists)
+    void buildSpatialRecursive(int nodeIndex, std::vector<TriangleReference>& refs, int depth);
+
+    AABB refitRecursive(const Model3D& model, int nodeIndex, int depth, DirtyRange& dirtyNodes);
+
+    // node order of parallel build depends on scheduling, preorder (left first) does not,
+    // leaf triangle ranges are compacted in the same order
+    void reorderDepthFirst();
+
+    BVHBuildSettings settings;
+    BVHBuildTimings buildTimings;
+    std::unique_ptr<ThreadPool> threadPool;
     std::vector<Node> nodeList;
-    std::vector<Triangle> vecTriangle;
+    std::atomic<int> nodeCount { 0 }; // used part of nodeList during build
+
+    std::vector<int> triangleIndices;
+    std::vector<float> triangleWeights;
+
+    // build time data, indexed by triangle index (not by position in triangleIndices)
+    std::vector<AABB> triangleBounds;
+    std::vector<glm::vec3> triangleCenters;
+    std::vector<uint64_t> mortonCodes; // LBVH only, same order as triangleIndices
+
+    // SBVH only
+    const Model3D* spatialModel = nullptr;
+    float spatialRootArea = 0.0f;
+    int maxReferenceCount = 0;
+    std::atomic<int> referenceCount { 0 }; // references in the tree, limited by maxReferenceCount
+    std::atomic<int> leafReferenceCount { 0 }; // used part of triangleIndices
+    int modelTriangleCount = 0;
 };
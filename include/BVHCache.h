@@ -0,0 +1,48 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "GeometryTexture.h"
+#include "MappedFile.h"
+#include "ModelLoader.h"
+
+#include <cstdint>
+#include <string>
+
+// Versioned binary cache of everything derived from an OBJ file: Model3D, BVH nodes, triangle indices
+// and the packed geometry texture. The file is memory mapped on load, so startup reads only pages
+// that are used, and the texture is uploaded directly from the mapping.
+class BVHCache {
+public:
+    struct Key {
+        uint64_t sourceHash = 0; // content of the source file
+        uint64_t settingsHash = 0; // BVHBuildSettings and the caller variant (node format, extra passes)
+    };
+
+    // false when the source file can not be read
+    static bool makeKey(std::string const& sourcePath, BVHBuildSettings const& settings, uint32_t variant, Key& key);
+
+    // writes to a temporary file and renames it, so a crash never leaves a broken cache
+    static bool save(std::string const& cachePath, Key const& key, const Model3D& model, const BVHBuilder& bvh, const GeometryTexture& texture);
+
+    // maps the file, false when it is missing, truncated, of another version, built for another key
+    // or when a section lies outside the file, callers rebuild then
+    bool open(std::string const& cachePath, Key const& key);
+
+    // copies into the std::vector based structures
+    void loadModel(Model3D& model) const;
+    void loadBVH(BVHBuilder& bvh) const;
+
+    // point into the mapping, valid while this object is alive
+    GeometryTexture::Layout getTextureLayout() const;
+    const float* getTexturePixels() const;
+    std::string getShaderDefines() const;
+
+private:
+    struct Header;
+    const Header& header() const;
+
+    template <typename T>
+    const T* section(uint64_t offset) const { return reinterpret_cast<const T*>(file.getData() + offset); }
+
+    MappedFile file;
+};
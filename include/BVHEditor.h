@@ -0,0 +1,99 @@
+#pragma once
+
+#include "BVHBuilder.h"
+
+#include <vector>
+
+struct BVHEditSettings {
+    // full rebuild when SAH cost grows past this ratio of the cost right after the last build
+    float rebuildCostRatio = 1.3f;
+    // tree rotations on the path from an edited leaf to the root
+    bool rotate = true;
+    // dirty elements closer than this are reported as one range, fewer and bigger uploads
+    int dirtyRangeGap = 16;
+    // full rebuild when this part of triangle index slots is free, multi-primitive leaves of insertSubtree()
+    // need contiguous runs, so holes left by removals would otherwise grow the index array without bound
+    float rebuildFreeSlotRatio = 0.25f;
+};
+
+// result of a batch of edits, sorted disjoint ranges of BVHBuilder::getNodes() and getTriangleIndices()
+struct BVHEditReport {
+    std::vector<DirtyRange> nodes;
+    std::vector<DirtyRange> triangleIndices;
+    bool rebuilt = false; // node and index counts may differ, upload everything
+    float costBefore = 0.0f; // SAH cost after the last build
+    float costAfter = 0.0f;
+    float freeSlotRatio = 0.0f; // free part of triangle indices at the end of the batch, before a rebuild
+};
+
+// Incremental insertion and removal of primitives (triangles, instances) in a built binary tree,
+// for scenes that change a little every frame. A new primitive gets its own leaf, paired with the sibling
+// chosen by branch and bound over the SAH cost increase (Bittner et al. 2012), ancestors are refitted
+// and locally rebalanced by rotations (Kopta et al. 2012). A removed leaf gives its parent to the sibling.
+// Freed nodes and triangle index slots are reused, so unchanged parts keep their place in the texture
+// and only dirty ranges need an upload. Quality drift is checked per batch, see finishEdits().
+// The tree must be built without spatial splits, every primitive is referenced once.
+class BVHEditor {
+public:
+    // primitiveBounds - bounds of every primitive the tree references, by primitive index
+    BVHEditor(BVHBuilder& bvh, std::vector<AABB> primitiveBounds, BVHEditSettings const& settings = BVHEditSettings());
+
+    // bounds of model.triangles[first, first + count)
+    static std::vector<AABB> triangleBounds(const Model3D& model, int first, int count);
+
+    // primitive index may be new (appended triangles) or a removed one
+    void insert(int primitive, AABB const& bounds);
+
+    // A separately built tree of one object placed as a whole, its primitive i becomes primitiveOffset + i.
+    // Keeps the object tree quality, much cheaper than inserting its primitives one by one
+    void insertSubtree(const BVHBuilder& subtree, std::vector<AABB> const& bounds, int primitiveOffset);
+
+    void remove(int primitive);
+    bool contains(int primitive) const;
+
+    // Ends a batch of edits: rebuilds the tree from live primitives when its SAH cost drifted past
+    // settings.rebuildCostRatio or free index slots exceed settings.rebuildFreeSlotRatio,
+    // returns what changed since the previous call
+    BVHEditReport finishEdits();
+
+private:
+    // parents, leaf of every primitive and free lists of the current tree
+    void attach();
+
+    int allocateNode();
+    int allocateSlot();
+    // count contiguous slots, a free run when there is one, else appended
+    int allocateSlots(int count);
+    void freeNode(int nodeIndex);
+
+    // writes node and keeps parents and primitive leaves in sync with it
+    void setNode(int nodeIndex, Node const& node);
+
+    // node with the lowest cost of pairing with bounds
+    int findBestSibling(AABB const& bounds) const;
+
+    // makes nodeIndex (a detached leaf or subtree root) the sibling of the best node
+    void insertNode(int nodeIndex);
+
+    // from nodeIndex to the root: bounds, then rotations
+    void refitUpwards(int nodeIndex);
+    void rotate(int nodeIndex);
+
+    // sorted, deduplicated and merged by settings.dirtyRangeGap, indices are cleared
+    std::vector<DirtyRange> takeRanges(std::vector<int>& indices) const;
+
+    BVHBuilder& bvh;
+    BVHEditSettings settings;
+    std::vector<AABB> primitiveBounds;
+
+    std::vector<int> parents; // by node, -1 - root or free
+    std::vector<int> primitiveLeaf; // by primitive, -1 - not in the tree
+    std::vector<int> primitiveSlot; // position in triangleIndices
+    std::vector<int> freeNodes;
+    std::vector<int> freeSlots;
+
+    // changed since the last finishEdits(), may repeat
+    std::vector<int> dirtyNodes;
+    std::vector<int> dirtySlots;
+    float builtCost = 0.0f;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "BVHBuilder.h"
+
+#include <vector>
+
+// Quality of a built binary tree, the numbers behind builder and optimizer choices
+struct BVHMetrics {
+    // STACK_SIZE default of raytracing.frag, traceCloseHitV2 discards the pixel when it needs more entries
+    static constexpr int shaderStackSize = 15;
+
+    float sahCost = 0.0f; // BVHBuilder::computeSAHCost()
+    int nodeCount = 0;
+    int innerCount = 0;
+    int leafCount = 0;
+    int referenceCount = 0; // triangles listed by leaves, more than model triangles with SBVH
+
+    int maxDepth = 0; // of the deepest leaf, the root has depth 0
+    float averageLeafDepth = 0.0f;
+    std::vector<int> depthHistogram; // leaves per depth
+    std::vector<int> leafSizeHistogram; // leaves per triangle count
+
+    // traceCloseHitV2 stack entries in the worst case: a deferred sibling per level plus two pushed children
+    int requiredStackSize = 0;
+
+    // EPO-like overlap: sum of SA(left box & right box) over inner nodes / SA(root),
+    // rays in the shared volume visit both subtrees
+    float siblingOverlap = 0.0f;
+    float overlappingSiblingRatio = 0.0f; // part of inner nodes with intersecting child boxes
+
+    bool fitsShaderStack() const { return requiredStackSize <= shaderStackSize; }
+
+    static BVHMetrics compute(const BVHBuilder& bvh);
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "BVHBuilder.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+struct BVHOptimizeSettings {
+    int treeletSize = 7; // leaves of restructured treelet, 3..8, optimal topology search is O(3^n)
+    int maxPasses = 3; // bottom-up passes over the whole tree
+    float maxMilliseconds = 0.0f; // time limit, 0 - no limit (remaining treelets are left as they are)
+};
+
+struct BVHOptimizeReport {
+    float costBefore = 0.0f; // BVHBuilder::computeSAHCost()
+    float costAfter = 0.0f;
+    int passes = 0;
+    int restructuredTreelets = 0;
+    double milliseconds = 0.0;
+};
+
+// Post-build tree optimization by treelet restructuring (Karras & Aila 2013):
+// for every node a treelet of up to treeletSize leaves is grown by expanding the largest child,
+// then its internal topology is replaced by the one with the lowest SAH cost.
+// Only inner nodes of treelets are rewired, leaves and triangle ranges stay, so the result
+// has the same Node layout as the input. Subtrees are processed in parallel.
+class BVHOptimizer {
+public:
+    BVHOptimizer();
+    BVHOptimizer(BVHOptimizeSettings const& settings);
+
+    BVHOptimizeReport optimize(BVHBuilder& bvh);
+
+private:
+    // children first (left as a task near the root), then the treelet rooted here
+    void optimizeRecursive(int nodeIndex, int depth);
+    void restructureTreelet(int rootIndex);
+
+    float nodeArea(int nodeIndex) const;
+    bool timeIsOver() const;
+
+    BVHOptimizeSettings settings;
+
+    // valid during optimize()
+    BVHBuilder* bvh = nullptr;
+    std::vector<float> subtreeCost; // SAH cost of subtree, not normalized by root area
+    std::atomic<int> restructuredCount { 0 };
+    int64_t deadline = 0; // steady_clock ticks, 0 - none
+};
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "ModelLoader.h"
+#include "ThreadPool.h"
+
+#include <cassert>
+#include <cfloat>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+struct Ray {
+    glm::vec3 origin = glm::vec3(0);
+    glm::vec3 direction = glm::vec3(0, 0, 1);
+    float tMin = 0.0001f;
+    float tMax = FLT_MAX; // shrinks to the closest hit found so far
+};
+
+struct RayHit {
+    int triangle = -1; // index into Model3D::triangles, -1 - no hit
+    int instance = -1; // TwoLevelBVH instance of the hit mesh, -1 - not instanced
+    float t = FLT_MAX;
+    float u = 0.0f; // barycentric weight of the second vertex
+    float v = 0.0f; // barycentric weight of the third vertex
+
+    bool isHit() const { return triangle >= 0; }
+};
+
+// per ray counters, summed over rays by the caller
+struct TraversalStats {
+    long long nodeVisits = 0; // nodes popped and tested
+    long long stackPushes = 0;
+    long long triangleTests = 0;
+
+    // optional visit counter per node index, incremented by intersectNodes(), see RayDistribution
+    std::vector<uint32_t>* nodeVisitCounts = nullptr;
+};
+
+// CPU closest hit and occlusion queries, same conventions as traceCloseHitV2 and traceOcclusion in raytracing.frag
+namespace BVHTraversal {
+// 1 / direction, zero components are replaced by a tiny value of the same sign to avoid 0 * inf
+glm::vec3 safeInverse(glm::vec3 const& direction);
+
+// ray prepared for slab tests, near/far planes are chosen by direction sign,
+// so boxes with min > max (empty slots) never intersect
+struct SlabRay {
+    explicit SlabRay(Ray const& ray);
+
+    glm::vec3 origin;
+    glm::vec3 invDirection;
+    bool negative[3];
+};
+
+// slab test clipped to [tMin, tMax], tNear - entry distance
+bool intersectBox(AABB const& box, glm::vec3 const& origin, glm::vec3 const& invDirection, float tMin, float tMax, float& tNear);
+
+// primary ray of raytracing.frag main() through pixel (gl_FragCoord, origin bottom left)
+Ray cameraRay(glm::vec3 const& location, glm::mat3 const& viewToWorld, glm::vec2 const& resolution, glm::vec2 const& pixel);
+
+// Moller-Trumbore, updates ray.tMax and hit when the hit is inside (tMin, tMax)
+bool intersectTriangle(const Model3D& model, int triangle, Ray& ray, RayHit& hit);
+
+// binary Node tree, the nearer child is visited first
+bool intersect(const BVHBuilder& bvh, const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats = nullptr);
+
+// any hit in (ray.tMin, ray.tMax), traversal stops at the first one (shadow, ambient occlusion, visibility)
+bool occluded(const BVHBuilder& bvh, const Model3D& model, Ray const& ray, TraversalStats* stats = nullptr);
+
+// Batched occlusion: bit i % 64 of word i / 64 is set when rays[i] hits something.
+// Words are split over threadPool when given, the result does not depend on the thread count
+std::vector<uint64_t> occluded(const BVHBuilder& bvh, const Model3D& model, std::vector<Ray> const& rays,
+    TraversalStats* stats = nullptr, ThreadPool* threadPool = nullptr);
+
+// Stack of the traversal loops: entries live in a local array and move to the heap only when a tree is deeper
+// than inlineCapacity allows (midpoint, SBVH and edited trees have no depth limit), so no tree overflows it
+template <typename Entry, int InlineCapacity = 256>
+class TraversalStack {
+public:
+    TraversalStack() = default;
+    TraversalStack(TraversalStack const&) = delete;
+    TraversalStack& operator=(TraversalStack const&) = delete;
+
+    bool empty() const { return size == 0; }
+    int getSize() const { return size; }
+
+    void push(Entry const& entry)
+    {
+        if (size == capacity)
+            grow();
+        entries[size++] = entry;
+    }
+    Entry pop() { return entries[--size]; }
+    void clear() { size = 0; }
+
+private:
+    void grow()
+    {
+        if (entries == local)
+            heap.assign(local, local + size);
+        heap.resize(size_t(capacity) * 2);
+        entries = heap.data();
+        capacity *= 2;
+    }
+
+    Entry local[InlineCapacity];
+    std::vector<Entry> heap;
+    Entry* entries = local;
+    int size = 0;
+    int capacity = InlineCapacity;
+};
+
+// child access of Node: both children are stored
+struct NodeChildren {
+    int left(const Node& node, int) const { return node.leftChild; }
+    int right(const Node& node, int) const { return node.rightChild; }
+};
+
+// Closest hit loop over binary trees shared by triangle and instance leaves and by node layouts.
+// NodeType needs aabb and isLeaf(), children.left(node, index) and children.right(node, index) give child indices.
+// intersectLeaf(leaf, counters) tests the primitives of a leaf, shrinks ray.tMax and returns true on a closer hit.
+// AnyHit - the loop ends at the first leaf that reports a hit, for occlusion queries
+template <bool AnyHit = false, typename NodeType, typename ChildAccess, typename IntersectLeaf>
+bool intersectNodes(const std::vector<NodeType>& nodes, Ray& ray, TraversalStats* stats,
+    ChildAccess const& children, IntersectLeaf const& intersectLeaf)
+{
+    if (nodes.empty())
+        return false;
+
+    const glm::vec3 invDirection = safeInverse(ray.direction);
+    TraversalStats counters;
+    std::vector<uint32_t>* nodeVisitCounts = stats ? stats->nodeVisitCounts : nullptr;
+    assert((!nodeVisitCounts || nodeVisitCounts->size() == nodes.size()) && "Node visit counts are for another tree");
+
+    struct Entry {
+        int node;
+        float tNear;
+    };
+    TraversalStack<Entry> stack;
+
+    float rootNear;
+    if (intersectBox(nodes[0].aabb, ray.origin, invDirection, ray.tMin, ray.tMax, rootNear))
+        stack.push({ 0, rootNear });
+
+    bool isHit = false;
+    while (!stack.empty()) {
+        const Entry entry = stack.pop();
+        if (entry.tNear > ray.tMax)
+            continue;
+
+        const NodeType& node = nodes[entry.node];
+        counters.nodeVisits++;
+        if (nodeVisitCounts)
+            (*nodeVisitCounts)[entry.node]++;
+
+        if (node.isLeaf()) {
+            isHit |= intersectLeaf(node, counters);
+            if (AnyHit && isHit)
+                break;
+            continue;
+        }
+
+        const int leftChild = children.left(node, entry.node);
+        const int rightChild = children.right(node, entry.node);
+        float leftNear, rightNear;
+        bool leftHit = intersectBox(nodes[leftChild].aabb, ray.origin, invDirection, ray.tMin, ray.tMax, leftNear);
+        bool rightHit = intersectBox(nodes[rightChild].aabb, ray.origin, invDirection, ray.tMin, ray.tMax, rightNear);
+
+        // the nearer child goes last, so it is popped first
+        if (leftHit && rightHit && leftNear < rightNear) {
+            stack.push({ rightChild, rightNear });
+            stack.push({ leftChild, leftNear });
+            counters.stackPushes += 2;
+        } else {
+            if (leftHit) {
+                stack.push({ leftChild, leftNear });
+                counters.stackPushes++;
+            }
+            if (rightHit) {
+                stack.push({ rightChild, rightNear });
+                counters.stackPushes++;
+            }
+        }
+    }
+
+    if (stats) {
+        stats->nodeVisits += counters.nodeVisits;
+        stats->stackPushes += counters.stackPushes;
+        stats->triangleTests += counters.triangleTests;
+    }
+    return isHit;
+}
+
+// binary Node trees of BVHBuilder
+template <bool AnyHit = false, typename IntersectLeaf>
+bool intersectNodes(const std::vector<Node>& nodes, Ray& ray, TraversalStats* stats, IntersectLeaf const& intersectLeaf)
+{
+    return intersectNodes<AnyHit>(nodes, ray, stats, NodeChildren(), intersectLeaf);
+}
+
+// Closest hit loop shared by wide node formats. Node must have child[] and triangleCount[] like WideNode,
+// intersectChildren(node, tMin, tMax, tNear) returns the bit mask of hit slots.
+// Leaves are intersected at once, inner children are pushed far to near.
+template <int Width, typename NodeType, typename IntersectChildren>
+bool intersectWide(const std::vector<NodeType>& nodes, const std::vector<int>& triangleIndices, const Model3D& model,
+    Ray& ray, RayHit& hit, TraversalStats* stats, IntersectChildren const& intersectChildren)
+{
+    if (nodes.empty())
+        return false;
+
+    TraversalStats counters;
+
+    struct Entry {
+        int node;
+        float tNear;
+    };
+    TraversalStack<Entry> stack;
+    stack.push({ 0, ray.tMin });
+
+    bool isHit = false;
+    while (!stack.empty()) {
+        const Entry entry = stack.pop();
+        if (entry.tNear > ray.tMax)
+            continue;
+
+        const NodeType& node = nodes[entry.node];
+        counters.nodeVisits++;
+
+        alignas(32) float tNear[Width];
+        int mask = intersectChildren(node, ray.tMin, ray.tMax, tNear);
+
+        Entry innerHits[Width];
+        int innerHitCount = 0;
+        for (; mask; mask &= mask - 1) {
+            int slot = 0;
+            while (!(mask & (1 << slot)))
+                ++slot;
+
+            if (node.triangleCount[slot] > 0) {
+                const int first = node.child[slot];
+                for (int i = first; i < first + node.triangleCount[slot]; ++i) {
+                    counters.triangleTests++;
+                    isHit |= intersectTriangle(model, triangleIndices[i], ray, hit);
+                }
+                continue;
+            }
+
+            int position = innerHitCount++;
+            while (position > 0 && innerHits[position - 1].tNear < tNear[slot]) {
+                innerHits[position] = innerHits[position - 1];
+                --position;
+            }
+            innerHits[position] = { node.child[slot], tNear[slot] };
+        }
+
+        for (int i = 0; i < innerHitCount; ++i)
+            stack.push(innerHits[i]);
+        counters.stackPushes += innerHitCount;
+    }
+
+    if (stats) {
+        stats->nodeVisits += counters.nodeVisits;
+        stats->stackPushes += counters.stackPushes;
+        stats->triangleTests += counters.triangleTests;
+    }
+    return isHit;
+}
+} // namespace BVHTraversal
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "BVHBuilder.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct ClusterSettings {
+    // node pixels are stored in tiles of tileWidth x tileHeight texels, one treelet per tile,
+    // both powers of two, tileWidth >= 4 (a sibling pair takes 4 texels)
+    int tileWidth = 8;
+    int tileHeight = 4;
+};
+
+// Cache-aware layout of a built binary tree: sibling pairs are grouped into treelets that fill
+// the rest of the current texture tile, grown by the largest surface area (probability of a ray reaching the node).
+// The largest subtree below a treelet is laid out next, so a descending ray stays within few tiles.
+// Nodes keep the Node format, so traversal is unchanged; slot 1 is padding, never referenced.
+class ClusteredBVH {
+public:
+    ClusteredBVH();
+    ClusteredBVH(ClusterSettings const& settings);
+
+    void build(const BVHBuilder& bvh);
+
+    const std::vector<Node>& getNodes() const { return nodes; }
+    const std::vector<int>& getTriangleIndices() const { return triangleIndices; }
+    ClusterSettings const& getSettings() const { return settings; }
+    // STACK_SIZE of the shader traversal, BVHMetrics::requiredStackSize of the source tree
+    int getMaxStackSize() const { return maxStackSize; }
+
+    // texel of a node section pixel, tiles fill rows of the texture, same as getNodeData in raytracing.frag
+    static glm::ivec2 tiledTexel(int pixel, int textureWidth, int tileWidth, int tileHeight);
+
+private:
+    ClusterSettings settings;
+    std::vector<Node> nodes;
+    std::vector<int> triangleIndices;
+    int maxStackSize = 1;
+};
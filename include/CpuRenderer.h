@@ -0,0 +1,74 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+#include "PacketBVH.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct CpuRenderSettings {
+    int width = 1920;
+    int height = 1080;
+    int tileSize = 32; // square tiles, one task each
+    int threadCount = 0; // 0 - all hardware threads
+    // 0 - single rays, 4, 8 or 16 - packets of 2x2, 4x2 or 4x4 pixels traced by PacketBVH
+    // (the widest kernel of this CPU up to that width)
+    int packetWidth = 0;
+};
+
+// attributes at the closest hit, Hit of raytracing.frag
+struct SurfaceHit {
+    glm::vec3 position = glm::vec3(0);
+    glm::vec3 normal = glm::vec3(0);
+    glm::vec2 uv = glm::vec2(0);
+    bool isHit = false;
+};
+
+// Headless raytracing.frag for hosts without a GPU and a reference for the GPU output:
+// closest hit through BVHTraversal on the binary tree (same conventions as traceCloseHitV2),
+// the image is split to tiles scheduled on a thread pool and shaded by the normal like main() of the shader
+class CpuRenderer {
+public:
+    CpuRenderer();
+    CpuRenderer(CpuRenderSettings const& settings);
+
+    // camera is given like the shader uniforms
+    void render(const BVHBuilder& bvh, const Model3D& model, glm::vec3 const& location, glm::mat3 const& viewToWorld);
+
+    // interpolated normal and uv of the hit triangle, as isect_tri() of the shader
+    static SurfaceHit surface(const Model3D& model, Ray const& ray, RayHit const& hit);
+
+    // RGB8, rows from top to bottom (the shader's gl_FragCoord starts at the bottom)
+    const std::vector<uint8_t>& getPixels() const { return pixels; }
+    int getWidth() const { return settings.width; }
+    int getHeight() const { return settings.height; }
+
+    // of the last render(), with packets nodeVisits counts packet node visits
+    const TraversalStats& getStats() const { return stats; }
+    int getPacketWidth() const { return packetWidth; } // 0 - single rays
+    double getMilliseconds() const { return milliseconds; }
+
+    // binary PPM (P6)
+    bool writePPM(std::string const& path) const;
+
+private:
+    void renderTile(const BVHBuilder& bvh, const Model3D& model, glm::vec3 const& location, glm::mat3 const& viewToWorld,
+        int tileX, int tileY, TraversalStats& tileStats);
+    void renderTilePackets(const Model3D& model, glm::vec3 const& location, glm::mat3 const& viewToWorld,
+        int tileX, int tileY, TraversalStats& tileStats);
+    Ray pixelRay(glm::vec3 const& location, glm::mat3 const& viewToWorld, int x, int y) const;
+    void shadePixel(const Model3D& model, int x, int y, Ray const& ray, RayHit const& hit);
+
+    CpuRenderSettings settings;
+    std::unique_ptr<ThreadPool> threadPool;
+    PacketBVH packetBVH;
+    int packetWidth = 0;
+    std::vector<uint8_t> pixels;
+    TraversalStats stats;
+    double milliseconds = 0.0;
+};
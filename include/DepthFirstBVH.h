@@ -0,0 +1,46 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+
+#include <vector>
+
+// Node in depth-first preorder, the left child of an inner node is always the next node,
+// so only one link is stored:
+// inner: link - index of the right child (always > 0)
+// leaf: link - minus (first triangle << leafCountBits | triangle count), see DepthFirstBVH
+struct DepthFirstNode {
+    AABB aabb;
+    int link;
+
+    bool isLeaf() const { return link < 0; }
+};
+
+// Compact layout of a built binary tree: one link instead of two child indices (28 instead of 32 bytes)
+// and descending to the left child is a sequential fetch. Leaf triangle ranges are compacted in the same order.
+class DepthFirstBVH {
+public:
+    void build(const BVHBuilder& bvh);
+
+    const std::vector<DepthFirstNode>& getNodes() const { return nodes; }
+    const std::vector<int>& getTriangleIndices() const { return triangleIndices; }
+
+    // low bits of a leaf link holding the triangle count, enough for the largest leaf of the tree
+    int getLeafCountBits() const { return leafCountBits; }
+    // STACK_SIZE of the shader traversal, BVHMetrics::requiredStackSize of the source tree
+    int getMaxStackSize() const { return maxStackSize; }
+
+    int triangleOffset(DepthFirstNode const& leaf) const { return -leaf.link >> leafCountBits; }
+    int triangleCount(DepthFirstNode const& leaf) const { return -leaf.link & ((1 << leafCountBits) - 1); }
+
+    // closest hit, the nearer child is visited first like BVHTraversal::intersect
+    bool intersect(const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats = nullptr) const;
+
+private:
+    void emitPreorder(const BVHBuilder& bvh, int binaryIndex);
+
+    std::vector<DepthFirstNode> nodes;
+    std::vector<int> triangleIndices;
+    int leafCountBits = 1;
+    int maxStackSize = 1;
+};
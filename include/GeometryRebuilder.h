@@ -0,0 +1,61 @@
+#pragma once
+#include "GeometryTexture.h"
+#include "PixelBufferGL.h"
+#include "TextureGL.h"
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+
+struct GeometryRebuildSettings {
+    // texture data copied to pixel buffers per frame, whole rows, at least one
+    size_t bytesPerFrame = 8 << 20;
+};
+
+// Background geometry rebuild: the build function runs on a worker thread while the renderer
+// keeps tracing the current texture. The packed result is streamed to a new texture through two
+// alternating pixel buffers, a bounded chunk per frame, and handed out once the GPU finished the copies,
+// so the swap happens at a frame boundary and no frame waits for a build or a whole upload.
+class GeometryRebuilder {
+public:
+    // runs on the worker thread, must not call OpenGL (GeometryTexture constructors only pack)
+    using BuildFunction = std::function<GeometryTexture()>;
+
+    GeometryRebuilder();
+    GeometryRebuilder(GeometryRebuildSettings const& settings);
+
+    // starts a rebuild, false - the previous one is not finished yet
+    bool request(BuildFunction build);
+    bool isBusy() const { return state != State::Idle; }
+
+    // Render thread, once per frame before drawing: advances the upload,
+    // returns the new geometry with its texture ready when everything reached the GPU,
+    // a build that threw is logged and dropped
+    std::optional<GeometryTexture> poll();
+
+    // waits for the worker
+    ~GeometryRebuilder();
+
+private:
+    enum class State {
+        Idle,
+        Building,
+        Uploading,
+        Fencing
+    };
+
+    // copies the next rows through the next pixel buffer
+    void uploadChunk();
+
+    GeometryRebuildSettings settings;
+    State state = State::Idle;
+    std::future<GeometryTexture> building;
+
+    // valid while uploading and fencing
+    std::optional<GeometryTexture> pending;
+    std::unique_ptr<TextureGL> target;
+    std::vector<PixelBufferGL> pixelBuffers;
+    int nextBuffer = 0;
+    int nextRow = 0;
+    void* fence = nullptr; // GLsync of the last copy
+};
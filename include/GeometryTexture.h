@@ -0,0 +1,113 @@
+#pragma once
+#include "BVHBuilder.h"
+#include "ClusteredBVH.h"
+#include "DepthFirstBVH.h"
+#include "ModelLoader.h"
+#include "QuantizedBVH.h"
+#include "SkipBVH.h"
+#include "TextureGL.h"
+#include "TwoLevelBVH.h"
+#include "WideBVH.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// All geometry for raytracing.frag in one RGBA32F texture:
+// [nodes, 2 pixels each][triangle indices in leaf order, 1 pixel each][vertices, 2 pixels each]
+// Wide nodes take 2 * Width pixels: per 4 children minX, minY, minZ, maxX, maxY, maxZ, child, triangle count.
+// Depth-first nodes take 2 pixels like binary nodes, the second child slot is unused: inner - right child pixel,
+// leaf - its link as is (triangle offset relative to the index section and count).
+// Clustered nodes are binary nodes stored in tiles of NODE_TILE_WIDTH x NODE_TILE_HEIGHT texels,
+// the node section is padded to whole rows of tiles.
+// Skip nodes take 2 pixels like binary nodes: inner - skip pixel and 0, leaf - first triangle pixel and minus count.
+// Instanced scenes: top-level binary nodes, instance records of 4 pixels (rows of the world to object matrix,
+// then bottom-level root pixel and instance index) in top-level leaf order, then nodes of every unique mesh;
+// index and vertex sections hold every mesh once.
+// Quantized nodes take 4 (8 bit) or 6 (16 bit) pixels: origin and exponents, children,
+// packed min x/y/z and max x/y/z codes, packed leaf triangle counts.
+// Packed copy stays on CPU, so changed parts can be repacked and uploaded alone.
+// Constructors only pack (no OpenGL calls, any thread), the texture is created by the first getTexture().
+class GeometryTexture {
+public:
+    struct Layout {
+        int nodePixelCount;
+        int indexPixelCount;
+        int vertexPixelCount;
+        int width;
+        int height;
+    };
+
+    // headroom - extra capacity of every section as a fraction of its size, so the tree and the model
+    // can grow (BVHEditor) and still be updated in place, Layout counts are then capacities
+    GeometryTexture(const BVHBuilder& bvh, const Model3D& model, float headroom = 0.0f);
+
+    template <int Width>
+    GeometryTexture(const WideBVH<Width>& bvh, const Model3D& model);
+
+    template <typename Quant>
+    GeometryTexture(const QuantizedBVH<Quant>& bvh, const Model3D& model);
+
+    GeometryTexture(const ClusteredBVH& bvh, const Model3D& model);
+    GeometryTexture(const DepthFirstBVH& bvh, const Model3D& model);
+    GeometryTexture(const SkipBVH& bvh, const Model3D& model);
+    GeometryTexture(const TwoLevelBVH& scene);
+
+    // already packed pixels (BVHCache), uploaded straight from the given memory without a CPU copy,
+    // on the render thread, such texture can not be updated
+    GeometryTexture(Layout const& layout, const float* pixels, std::string const& shaderDefines);
+
+    // render thread only, creates and uploads the whole texture on the first call
+    TextureGL& getTexture();
+
+    // texture that already holds getPixels(), uploaded elsewhere (GeometryRebuilder)
+    void attachTexture(std::unique_ptr<TextureGL> uploaded);
+    Layout const& getLayout() const { return layout; }
+    const std::vector<float>& getPixels() const { return buffer; }
+
+    // node format #defines for raytracing.frag, see ShaderProgram
+    std::string const& getShaderDefines() const { return shaderDefines; }
+
+    // Repack given nodes / triangle indices / vertices and upload only texture rows that contain them.
+    // Counts must fit the capacity given in constructor (refit, deformation, BVHEditor), see hasRoomFor().
+    // updateNodes() and updateTriangleIndices() are for the binary node format only
+    void updateNodes(const BVHBuilder& bvh, DirtyRange nodes);
+    void updateTriangleIndices(const BVHBuilder& bvh, const Model3D& model, DirtyRange triangleIndices);
+    void updateVertices(const Model3D& model, DirtyRange vertices);
+
+    // false - the tree or the model outgrew the texture, a new one is needed
+    bool hasRoomFor(const BVHBuilder& bvh, const Model3D& model) const;
+
+private:
+    static Layout computeLayout(int nodePixelCount, int triangleCount, int vertexCount);
+
+    // node section padded to whole rows of tiles, the texture width may grow with it
+    static Layout computeTiledLayout(int nodePixelCount, int triangleCount, int vertexCount, int tileHeight);
+
+    static Layout computeInstancedLayout(const TwoLevelBVH& scene);
+
+    // nodes[begin, end) of a tree packed from firstPixel on, a leaf links to leafPixel + triangle offset * leafStride
+    void packNodes(const std::vector<Node>& nodes, int begin, int end, int firstPixel, int leafPixel, int leafStride);
+
+    // moves packed node pixels to their tiles
+    void tileNodes(int tileWidth, int tileHeight);
+    template <int Width>
+    void packWideNodes(const WideBVH<Width>& bvh);
+    template <typename Quant>
+    void packQuantizedNodes(const QuantizedBVH<Quant>& bvh);
+    void packDepthFirstNodes(const DepthFirstBVH& bvh);
+    void packSkipNodes(const SkipBVH& bvh);
+    void packInstances(const TwoLevelBVH& scene);
+    void packTriangles(const std::vector<int>& triangleIndices, const Model3D& model, int begin, int end, int firstPixel, int vertexPixel);
+    void packVertices(const Model3D& model, int begin, int end, int firstPixel);
+
+    // packs triangles and vertices
+    void packGeometry(const std::vector<int>& triangleIndices, const Model3D& model);
+
+    // upload whole rows containing pixels [firstPixel, endPixel)
+    void uploadPixels(int firstPixel, int endPixel);
+
+    Layout layout;
+    std::vector<float> buffer;
+    std::unique_ptr<TextureGL> texture;
+    std::string shaderDefines;
+};
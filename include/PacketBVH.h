@@ -0,0 +1,52 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+#include "RayPacket.h"
+
+#include <vector>
+
+enum class PacketInstructionSet {
+    Scalar, // portable 4 lane kernel, CPUs other than x86-64
+    SSE2, // 4 lanes
+    AVX2, // 8 lanes
+    AVX512 // 16 lanes
+};
+
+// Binary tree of a BVHBuilder flattened for packet traversal of coherent rays (pixel blocks of a pinhole camera):
+// 4, 8 or 16 rays go down the tree together with SIMD slab and triangle tests, see PacketKernel.h.
+// Kernels are compiled per instruction set, the widest one the CPU supports is chosen at runtime
+class PacketBVH {
+public:
+    PacketBVH();
+
+    void build(const BVHBuilder& bvh, const Model3D& model);
+
+    // widest instruction set of this CPU
+    static PacketInstructionSet detectInstructionSet();
+    static int laneCount(PacketInstructionSet instructionSet);
+
+    // chooses the widest supported kernel with at most width lanes (at least 4), returns its lane count
+    int selectWidth(int width);
+    PacketInstructionSet getInstructionSet() const { return instructionSet; }
+    int getPacketWidth() const { return laneCount(instructionSet); }
+
+    // Closest hit of lanes [0, packet.count), count <= getPacketWidth(), updates tMax, u, v and triangle like
+    // BVHTraversal::intersect(). stats->nodeVisits counts nodes visited by the packet, not by its rays
+    void intersect(RayPacket& packet, TraversalStats* stats = nullptr) const;
+
+    // any hit of every lane, packet.triangle >= 0 marks blocked lanes, the packet ends when all lanes are blocked
+    void occluded(RayPacket& packet, TraversalStats* stats = nullptr) const;
+
+    const std::vector<PacketNode>& getNodes() const { return nodes; }
+
+private:
+    void trace(RayPacket& packet, TraversalStats* stats, bool anyHit) const;
+
+    static constexpr int localStackSize = 256;
+
+    std::vector<PacketNode> nodes;
+    std::vector<PacketTriangle> triangles;
+    int stackSize = 1; // kernel stack entries the tree needs, max leaf depth + 1
+    PacketInstructionSet instructionSet;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "RayPacket.h"
+
+// Packet closest hit shared by the SIMD kernels: a popped node is tested against all lanes at once,
+// subtrees no active lane hits are skipped, children are pushed in the order of the packet's first ray.
+// Triangles are tested one at a time against all lanes (Moller-Trumbore, the operation order of
+// BVHTraversal::intersectTriangle(), so hits are bit exact with single ray traversal without FMA contraction).
+// Lanes - static functions of one instruction set: F (float lanes), M (lane mask), width,
+// load, store, broadcast, add, sub, mul, div, min, max, lt, le, gt, maskAnd, maskOr, maskNot, bits, select, firstLanes.
+// Every kernel instantiates it in its own translation unit with a lane type in an anonymous namespace,
+// so no code compiled for a wider instruction set is shared with the rest of the program.
+// AnyHit - occlusion: a lane retires at its first hit (triangle set, tMax, u, v of that hit), the packet ends
+// when all lanes retired. Returns the number of visited nodes.
+// stack - scratch of at least max leaf depth + 1 entries (BVHMetrics::requiredStackSize), both children are pushed
+template <typename Lanes, bool AnyHit = false>
+long long intersectPacketLanes(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack)
+{
+    using F = typename Lanes::F;
+    using M = typename Lanes::M;
+
+    F origin[3], direction[3], invDirection[3];
+    for (int a = 0; a < 3; ++a) {
+        origin[a] = Lanes::load(packet.origin[a]);
+        direction[a] = Lanes::load(packet.direction[a]);
+        invDirection[a] = Lanes::load(packet.invDirection[a]);
+    }
+    const F tMin = Lanes::load(packet.tMin);
+    F tMax = Lanes::load(packet.tMax);
+    F u = Lanes::load(packet.u);
+    F v = Lanes::load(packet.v);
+    M active = Lanes::firstLanes(packet.count);
+
+    bool positive[3];
+    for (int a = 0; a < 3; ++a)
+        positive[a] = packet.direction[a][0] >= 0.0f;
+
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    long long nodeVisits = 0;
+
+    while (stackSize > 0) {
+        const PacketNode& node = nodes[stack[--stackSize]];
+
+        // slab test like BVHTraversal::intersectBox()
+        F tNear = tMin;
+        F tFar = tMax;
+        for (int a = 0; a < 3; ++a) {
+            const F t0 = Lanes::mul(Lanes::sub(Lanes::broadcast(node.bounds[a]), origin[a]), invDirection[a]);
+            const F t1 = Lanes::mul(Lanes::sub(Lanes::broadcast(node.bounds[a + 3]), origin[a]), invDirection[a]);
+            tNear = Lanes::max(tNear, Lanes::min(t0, t1));
+            tFar = Lanes::min(tFar, Lanes::max(t0, t1));
+        }
+        const M boxHit = Lanes::maskAnd(active, Lanes::le(tNear, tFar));
+        if (!Lanes::bits(boxHit))
+            continue;
+        nodeVisits++;
+
+        if (node.rightChild >= 0) {
+            const bool leftFirst = positive[node.orderAxis] != bool(node.orderFlip);
+            stack[stackSize++] = leftFirst ? node.rightChild : node.leftChild;
+            stack[stackSize++] = leftFirst ? node.leftChild : node.rightChild;
+            continue;
+        }
+
+        const int triangleEnd = node.leftChild - node.rightChild;
+        for (int i = node.leftChild; i < triangleEnd; ++i) {
+            const PacketTriangle& triangle = triangles[i];
+            F e1[3], e2[3], toOrigin[3];
+            for (int a = 0; a < 3; ++a) {
+                e1[a] = Lanes::broadcast(triangle.e1[a]);
+                e2[a] = Lanes::broadcast(triangle.e2[a]);
+                toOrigin[a] = Lanes::sub(origin[a], Lanes::broadcast(triangle.v0[a]));
+            }
+            auto cross = [](const F* x, const F* y, F* result) {
+                result[0] = Lanes::sub(Lanes::mul(x[1], y[2]), Lanes::mul(y[1], x[2]));
+                result[1] = Lanes::sub(Lanes::mul(x[2], y[0]), Lanes::mul(y[2], x[0]));
+                result[2] = Lanes::sub(Lanes::mul(x[0], y[1]), Lanes::mul(y[0], x[1]));
+            };
+            auto dot = [](const F* x, const F* y) {
+                return Lanes::add(Lanes::add(Lanes::mul(x[0], y[0]), Lanes::mul(x[1], y[1])), Lanes::mul(x[2], y[2]));
+            };
+
+            F p[3], q[3];
+            cross(direction, e2, p);
+            const F invDet = Lanes::div(Lanes::broadcast(1.0f), dot(e1, p));
+            const F hitU = Lanes::mul(dot(toOrigin, p), invDet);
+            cross(toOrigin, e1, q);
+            const F hitV = Lanes::mul(dot(direction, q), invDet);
+            const F distance = Lanes::mul(dot(e2, q), invDet);
+
+            const F zero = Lanes::broadcast(0.0f);
+            const F one = Lanes::broadcast(1.0f);
+            const M outside = Lanes::maskOr(Lanes::maskOr(Lanes::lt(hitU, zero), Lanes::gt(hitU, one)),
+                Lanes::maskOr(Lanes::lt(hitV, zero), Lanes::gt(Lanes::add(hitU, hitV), one)));
+            const M inRange = Lanes::maskAnd(Lanes::gt(distance, tMin), Lanes::lt(distance, tMax));
+            const M hit = Lanes::maskAnd(Lanes::maskAnd(boxHit, inRange), Lanes::maskNot(outside));
+
+            unsigned hitBits = Lanes::bits(hit);
+            if (!hitBits)
+                continue;
+            tMax = Lanes::select(hit, distance, tMax);
+            u = Lanes::select(hit, hitU, u);
+            v = Lanes::select(hit, hitV, v);
+            for (int lane = 0; hitBits; ++lane, hitBits >>= 1) {
+                if (hitBits & 1)
+                    packet.triangle[lane] = triangle.index;
+            }
+            if (AnyHit) {
+                active = Lanes::maskAnd(active, Lanes::maskNot(hit));
+                if (!Lanes::bits(active)) {
+                    stackSize = 0;
+                    break;
+                }
+            }
+        }
+    }
+
+    Lanes::store(packet.tMax, tMax);
+    Lanes::store(packet.u, u);
+    Lanes::store(packet.v, v);
+    return nodeVisits;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// GL_PIXEL_UNPACK_BUFFER, texture updates from it return before the data reaches the texture
+class PixelBufferGL {
+public:
+    PixelBufferGL(size_t capacity);
+    PixelBufferGL(PixelBufferGL&& other);
+    size_t getCapacity() const { return capacity; }
+
+    // replaces the content, the old storage is orphaned, so a copy still reading it does not stall the call
+    void write(const void* data, size_t size);
+    void bind();
+    static void unbind();
+    ~PixelBufferGL();
+
+private:
+    uint32_t bufferID;
+    size_t capacity;
+};
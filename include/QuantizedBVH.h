@@ -0,0 +1,48 @@
+#pragma once
+
+#include "BVHTraversal.h"
+#include "WideBVH.h"
+
+#include <cstdint>
+#include <vector>
+
+// 4-wide node with child bounds quantized to the node box: plane = origin + q * 2^(exponent - 127).
+// Min planes are rounded down and max planes up, so decoded boxes always contain the exact ones.
+// Empty slots have min code above max code (never hit) and child -1.
+template <typename Quant>
+struct QuantizedNode {
+    static constexpr int width = 4;
+
+    float origin[3]; // node box min
+    uint8_t exponent[3]; // biased like float exponent bits, scale bits = exponent << 23
+    uint8_t triangleCount[width]; // leaf: > 0, inner child or empty slot: 0
+    Quant boundsMin[3][width]; // [axis][slot]
+    Quant boundsMax[3][width];
+    int child[width]; // inner child: node index, leaf: first triangle in getTriangleIndices(), empty: -1
+};
+
+// Compressed copy of WideBVH4, Quant - uint8_t or uint16_t per plane
+template <typename Quant>
+class QuantizedBVH {
+    static_assert(sizeof(Quant) == 1 || sizeof(Quant) == 2, "QuantizedBVH supports 8 and 16 bit planes");
+
+public:
+    static constexpr int bits = sizeof(Quant) * 8;
+
+    void build(const WideBVH4& bvh);
+
+    const std::vector<QuantizedNode<Quant>>& getNodes() const { return nodes; }
+    const std::vector<int>& getTriangleIndices() const { return triangleIndices; }
+    int getMaxStackSize() const { return maxStackSize; }
+
+    // closest hit, planes of 4 children are decoded and tested by one SIMD slab test
+    bool intersect(const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats = nullptr) const;
+
+private:
+    std::vector<QuantizedNode<Quant>> nodes;
+    std::vector<int> triangleIndices;
+    int maxStackSize = 0;
+};
+
+using QuantizedBVH8 = QuantizedBVH<uint8_t>;
+using QuantizedBVH16 = QuantizedBVH<uint16_t>;
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <random>
+#include <vector>
+
+// Observed ray traffic of a built binary tree: node visit counters from CPU closest hit traversal of real rays.
+// SAH assumes uniformly distributed rays, camera rays are not, so the counters are turned to ray density
+// around every triangle for a weighted binned SAH rebuild, see BVHBuilder::setTriangleWeights().
+// GL 3.3 shaders have no atomic counters, so the renderer samples its camera rays on the CPU.
+class RayDistribution {
+public:
+    // keeps references, tree and model must outlive recording
+    RayDistribution(const BVHBuilder& bvh, const Model3D& model);
+
+    // traces the ray and counts the nodes it visits
+    bool record(Ray ray);
+
+    // count random pixels of the camera of raytracing.frag main()
+    void recordCamera(glm::vec3 const& location, glm::mat3 const& viewToWorld, glm::vec2 const& resolution, int count);
+
+    long long getRayCount() const { return rayCount; }
+    long long getNodeVisitCount() const { return nodeVisitCount; }
+    const std::vector<uint32_t>& getNodeVisits() const { return nodeVisits; }
+    void reset();
+
+    // Visits per unit area of the leaf of every triangle (by triangle index), divided by its mean,
+    // uniformShare of every weight stays uniform, so parts no recorded ray reached keep SAH structure
+    std::vector<float> triangleWeights(float uniformShare = 0.1f) const;
+
+private:
+    const BVHBuilder& bvh;
+    const Model3D& model;
+    std::vector<uint32_t> nodeVisits;
+    long long rayCount = 0;
+    long long nodeVisitCount = 0;
+    std::mt19937 random;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+struct Ray;
+struct RayHit;
+
+// Structure of arrays of up to maxWidth rays traced together, lanes [0, count) are active.
+// Plain data only, the SIMD kernels (PacketKernel.h) include nothing else
+struct RayPacket {
+    static constexpr int maxWidth = 16;
+
+    alignas(64) float origin[3][maxWidth];
+    alignas(64) float direction[3][maxWidth];
+    alignas(64) float invDirection[3][maxWidth]; // BVHTraversal::safeInverse() of direction
+    alignas(64) float tMin[maxWidth];
+    alignas(64) float tMax[maxWidth]; // shrinks to the closest hit found so far
+    alignas(64) float u[maxWidth];
+    alignas(64) float v[maxWidth];
+    alignas(64) int triangle[maxWidth]; // -1 - no hit
+    int count = 0;
+
+    // lane must be below maxWidth, count is not changed
+    void set(int lane, Ray const& ray);
+    Ray ray(int lane) const;
+    RayHit hit(int lane) const;
+};
+
+// binary tree node of PacketBVH, same child and leaf convention as Node
+struct PacketNode {
+    float bounds[6]; // min xyz, max xyz
+    int leftChild;
+    int rightChild;
+    // inner nodes: the left child is nearer for rays with a positive direction along orderAxis, unless orderFlip
+    int orderAxis;
+    int orderFlip;
+};
+
+// in leaf order, edges precomputed like BVHTraversal::intersectTriangle() computes them
+struct PacketTriangle {
+    float v0[3];
+    float e1[3];
+    float e2[3];
+    int index; // into Model3D::triangles
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+#include "PacketBVH.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// flat structure of arrays input, owned by the caller, count entries per array
+struct RayBuffer {
+    const float* origin[3] = {}; // x, y, z
+    const float* direction[3] = {}; // need not be normalized, t is in its units
+    const float* tMin = nullptr; // nullptr - Ray::tMin for every ray
+    const float* tMax = nullptr; // nullptr - no limit
+    int count = 0;
+};
+
+// flat structure of arrays output, entry i belongs to ray i, misses like RayHit()
+struct HitBuffer {
+    float* t = nullptr;
+    int* triangle = nullptr; // index into Model3D::triangles, -1 - miss
+    float* u = nullptr; // optional barycentrics, nullptr - not written
+    float* v = nullptr;
+};
+
+struct RayQuerySettings {
+    int threadCount = 0; // 0 - all hardware threads
+    int raysPerTask = 4096; // rounded up to whole occlusion mask words
+    // 0 - single rays only, 4, 8 or 16 - consecutive rays are traced as packets of up to this width when coherent
+    int packetWidth = 16;
+    // coherent packet: every direction within this cosine of the first one
+    // and every origin within this share of the scene diagonal from the first one
+    float coherentCosine = 0.99f;
+    float coherentOriginSpread = 0.01f;
+    // Stream mode for incoherent secondary rays (bounces, ambient occlusion): a batch is reordered by direction
+    // octant and Morton code of the origin cell (stable, so rays of one cell keep the caller order), traced
+    // in that order in packets of one octant, hits go straight to the caller order.
+    // Costs a sort of the batch, pays off for batches in no useful order
+    bool sortRays = false;
+    int streamCellBits = 6; // Morton bits per origin axis within the scene bounds, 1 to 10
+};
+
+// Throughput entry point for large batches of rays over one mesh: rays are read from and hits written to
+// caller buffers with no allocation per ray. Batches are split into tasks on a thread pool, within a task
+// consecutive rays of similar origin and direction (camera tiles, sorted ray streams) go through PacketBVH,
+// the rest through BVHTraversal one by one. Hit distances are bit exact on both paths and results do not depend
+// on the thread count; only triangles hit at exactly the same distance may be resolved differently by the two paths.
+class RayQuery {
+public:
+    // bvh and model are referenced, not copied, they must outlive the query
+    RayQuery(const BVHBuilder& bvh, const Model3D& model, RayQuerySettings const& settings = RayQuerySettings());
+
+    // closest hits
+    void intersect(RayBuffer const& rays, HitBuffer const& hits);
+
+    // any hits, bit i % 64 of mask[i / 64] is set when ray i is blocked, (count + 63) / 64 words
+    void occluded(RayBuffer const& rays, uint64_t* mask);
+
+    // of the last intersect() or occluded(): rays traced in packets, the rest went one by one
+    long long getPacketRayCount() const { return packetRayCount; }
+    int getPacketWidth() const { return packetWidth; } // 0 - single rays only
+
+private:
+    // Positions k of the trace order are rays order[k], nullptr - the caller order. Hits go to the ray index,
+    // the occlusion mask is written by position
+    void traceClosest(RayBuffer const& rays, HitBuffer const& hits, const int* order);
+    void traceOcclusion(RayBuffer const& rays, uint64_t* mask, const int* order);
+
+    // stream order of rays into streamOrder, their sorted keys into streamKeys, see RayQuerySettings::sortRays
+    void sortStream(RayBuffer const& rays);
+
+    // positions [first, first + count) go through PacketBVH
+    bool isPacket(RayBuffer const& rays, int first, int count, const int* order) const;
+    bool isCoherent(RayBuffer const& rays, int first, int count) const;
+    int taskSize() const;
+
+    const BVHBuilder& bvh;
+    const Model3D& model;
+    RayQuerySettings settings;
+    std::unique_ptr<ThreadPool> threadPool;
+    PacketBVH packetBVH;
+    int packetWidth = 0;
+    AABB sceneBounds;
+    float sceneDiagonal = 0.0f;
+    long long packetRayCount = 0;
+
+    // stream mode buffers, kept between batches
+    int streamOctantShift = 0;
+    std::vector<uint64_t> streamKeys;
+    std::vector<uint64_t> streamKeysTemp;
+    std::vector<int> streamOrder;
+    std::vector<int> streamOrderTemp;
+    std::vector<int> streamOffsets;
+    std::vector<uint64_t> streamMask; // by stream position
+};
@@ -4,7 +4,8 @@
 #include <string>
 class ShaderProgram {
 public:
-    ShaderProgram(std::string const& vertexShaderPath, std::string const& fragmentShaderPath);
+    // defines - "#define ..." lines inserted after #version of both shaders
+    ShaderProgram(std::string const& vertexShaderPath, std::string const& fragmentShaderPath, std::string const& defines = "");
     void bind();
     void setTexture(std::string const& textureName, uint32_t texID, int texUnitSlot);
     void setTextureAI(std::string const& textureName, TextureGL const& texture);
@@ -17,7 +18,7 @@ public:
     ~ShaderProgram();
 
 private:
-    std::string loadShaderByFile(std::string const& shaderPath);
+    std::string loadShaderByFile(std::string const& shaderPath, std::string const& defines);
     uint32_t programID;
     int texUnitSlotIndex;
 };
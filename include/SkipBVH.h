@@ -0,0 +1,36 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+
+#include <vector>
+
+// Threaded node in depth-first preorder: a hit inner node continues with the next node (its first child),
+// a missed node or a leaf continues with skip, the first node after its subtree
+struct SkipNode {
+    AABB aabb;
+    int skip; // getNodes().size() - end of traversal
+    int triangleOffset; // leaf: first triangle in getTriangleIndices()
+    int triangleCount; // leaf: > 0, inner: 0
+
+    bool isLeaf() const { return triangleCount > 0; }
+};
+
+// Skip pointer (rope) layout of a built binary tree for stackless traversal:
+// no per ray stack, so no stack overflow and no local memory traffic,
+// the price is a fixed front-to-back order (left child first) instead of the nearest child first.
+class SkipBVH {
+public:
+    void build(const BVHBuilder& bvh);
+
+    const std::vector<SkipNode>& getNodes() const { return nodes; }
+    const std::vector<int>& getTriangleIndices() const { return triangleIndices; }
+
+    bool intersect(const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats = nullptr) const;
+
+private:
+    void emitPreorder(const std::vector<Node>& binary, int binaryIndex);
+
+    std::vector<SkipNode> nodes;
+    std::vector<int> triangleIndices;
+};
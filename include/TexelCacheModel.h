@@ -0,0 +1,54 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// distinct texel cache lines touched, summed over rays
+struct TexelCacheStats {
+    long long nodeLines = 0;
+    long long geometryLines = 0; // triangle indices and vertices
+    long long fetches = 0; // texel fetches, a line may be fetched many times
+};
+
+// CPU emulation of the texture fetches of traceCloseHitV2 on a binary Node layout, a measure for node orderings:
+// a cache line is an aligned block of lineWidth x lineHeight texels of the geometry texture.
+class TexelCacheModel {
+public:
+    // where GeometryTexture puts the data
+    struct Placement {
+        int textureWidth = 0;
+        int nodePixelCount = 0; // first triangle index pixel
+        int indexPixelCount = 0;
+        int tileWidth = 0; // node section tiles (ClusteredBVH), 0 - row major like the rest
+        int tileHeight = 0;
+    };
+
+    // 4 x 2 RGBA32F texels - 128 byte line
+    TexelCacheModel(Placement const& placement, int lineWidth = 4, int lineHeight = 2);
+
+    // closest hit like traceCloseHitV2: a popped node is fetched, then both children of an inner node
+    bool trace(const std::vector<Node>& nodes, const std::vector<int>& triangleIndices, const Model3D& model,
+        Ray& ray, RayHit& hit, TexelCacheStats& stats);
+
+private:
+    glm::ivec2 texel(int pixel) const;
+    void fetch(int pixel, std::vector<int64_t>& lines);
+
+    const Node& fetchNode(const std::vector<Node>& nodes, int index);
+
+    // distinct lines of one ray
+    static long long countLines(std::vector<int64_t>& lines);
+
+    Placement placement;
+    int lineWidth;
+    int lineHeight;
+
+    // per ray
+    std::vector<int64_t> nodeLines;
+    std::vector<int64_t> geometryLines;
+    long long fetchCount = 0;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include "PixelBufferGL.h"
 #include <cstdint>
 
 enum class TextureGLType {
@@ -13,11 +14,18 @@ public:
     int getWidth();
     int getHeight();
     void bind();
+
+    // rewrite rectangle of texels, data is tightly packed width * height texels
+    void update(int x, int y, int width, int height, const void* data);
+
+    // the same from the start of a pixel buffer, returns without waiting for the copy
+    void update(int x, int y, int width, int height, PixelBufferGL& source);
     ~TextureGL();
     friend class ShaderProgram;
 
 private:
     int width;
     int height;
+    TextureGLType datatype;
     uint32_t textureID;
 };
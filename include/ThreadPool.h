@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker owns a deque, pushes and pops at the back,
+// idle workers steal from the front of other deques.
+// A thread waiting for a TaskGroup executes queued tasks instead of sleeping,
+// so nested task groups (recursive builds) do not deadlock.
+class ThreadPool {
+public:
+    // threadCount includes the thread that calls TaskGroup::wait(), 0 - all hardware threads
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int getThreadCount() const { return (int)workers.size() + 1; }
+
+    class TaskGroup {
+    public:
+        explicit TaskGroup(ThreadPool& pool)
+            : pool(pool)
+        {
+        }
+        ~TaskGroup() { waitPending(); }
+
+        void run(std::function<void()> task);
+
+        // waits for all tasks, then rethrows the first exception one of them threw
+        void wait();
+
+    private:
+        friend class ThreadPool;
+
+        // waits without rethrowing, tasks may still use the stack of the thread that owns the group
+        void waitPending();
+        void fail(std::exception_ptr exception);
+
+        ThreadPool& pool;
+        std::atomic<int> pending { 0 };
+        std::mutex errorMutex;
+        std::exception_ptr error; // first exception of a task
+    };
+
+    // Calls function(chunkBegin, chunkEnd) for [begin, end) split by grainSize.
+    // Chunk boundaries depend only on grainSize, not on thread count,
+    // so per-chunk results merged in chunk order are deterministic.
+    template <typename Function>
+    void parallelFor(int begin, int end, int grainSize, Function const& function)
+    {
+        TaskGroup group(*this);
+        for (int chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize) {
+            int chunkEnd = std::min(chunkBegin + grainSize, end);
+            group.run([&function, chunkBegin, chunkEnd] { function(chunkBegin, chunkEnd); });
+        }
+        group.wait();
+    }
+
+private:
+    struct Task {
+        std::function<void()> function;
+        TaskGroup* group;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task&& task);
+    bool tryRunOne(int queueIndex);
+    int currentQueueIndex() const;
+    void workerLoop(int queueIndex);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, the last one for external threads
+
+    std::atomic<int> queuedCount { 0 };
+    std::atomic<bool> stop { false };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+};
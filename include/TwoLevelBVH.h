@@ -0,0 +1,51 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct MeshInstance {
+    int mesh; // TwoLevelBVH::addMesh() index
+    glm::mat4 transform; // object to world
+    glm::mat4 inverse; // world to object
+};
+
+// Top-level BVH over instances of shared meshes. Every mesh keeps its own bottom-level tree in object space,
+// an instance is only a transform and a mesh reference, so memory scales with unique geometry.
+// Rays enter an instance transformed to object space without normalization, so t is the same in both spaces.
+class TwoLevelBVH {
+public:
+    struct Mesh {
+        const Model3D* model;
+        const BVHBuilder* bvh;
+    };
+
+    TwoLevelBVH();
+    TwoLevelBVH(BVHBuildSettings const& topLevelSettings);
+
+    // model and its built tree are referenced, not copied, they must outlive this object
+    int addMesh(const Model3D& model, const BVHBuilder& bvh);
+    int addInstance(int mesh, glm::mat4 const& transform);
+
+    // top-level tree over world bounds of instances, again after instances are added or moved
+    void build();
+
+    const std::vector<Mesh>& getMeshes() const { return meshes; }
+    const std::vector<MeshInstance>& getInstances() const { return instances; }
+
+    // leaves list instance indices in getTopLevel().getTriangleIndices()
+    const BVHBuilder& getTopLevel() const { return topLevel; }
+
+    // closest hit in world space, hit.triangle is a triangle of the mesh of hit.instance
+    bool intersect(Ray& ray, RayHit& hit, TraversalStats* stats = nullptr) const;
+
+    // any hit in world space, stops at the first blocking instance
+    bool occluded(Ray const& ray, TraversalStats* stats = nullptr) const;
+
+private:
+    std::vector<Mesh> meshes;
+    std::vector<MeshInstance> instances;
+    BVHBuilder topLevel;
+};
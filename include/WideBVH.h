@@ -0,0 +1,51 @@
+#pragma once
+
+#include "BVHBuilder.h"
+#include "BVHTraversal.h"
+
+#include <vector>
+
+// Node of a Width-ary tree, bounds of all children in SoA form so one SIMD slab test covers
+// 4 or 8 children. Unused slots have inverted bounds (never hit) and child -1.
+template <int Width>
+struct alignas(Width * sizeof(float)) WideNode {
+    float boundsMin[3][Width]; // [axis][slot]
+    float boundsMax[3][Width];
+    int child[Width]; // inner child: node index, leaf: first triangle in getTriangleIndices(), empty: -1
+    int triangleCount[Width]; // leaf: > 0, inner child or empty slot: 0
+
+    bool isEmpty(int slot) const { return child[slot] < 0; }
+    bool isLeaf(int slot) const { return triangleCount[slot] > 0; }
+};
+
+// Wide BVH collapsed from a built binary tree: every wide node takes the binary node's children
+// and repeatedly replaces the inner one with the largest area by its own children until
+// Width slots are used. Leaves keep their triangle ranges.
+template <int Width>
+class WideBVH {
+    static_assert(Width == 4 || Width == 8, "WideBVH supports 4 and 8 children");
+
+public:
+    void build(const BVHBuilder& bvh);
+
+    const std::vector<WideNode<Width>>& getNodes() const { return nodes; }
+    const std::vector<int>& getTriangleIndices() const { return triangleIndices; }
+
+    // upper bound of traversal stack entries, (Width - 1) per level
+    int getMaxStackSize() const { return maxDepth * (Width - 1) + 1; }
+
+    // closest hit, all children of a node are tested by one SIMD slab test
+    bool intersect(const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats = nullptr) const;
+
+private:
+    // creates the wide node for binary inner node, returns its index
+    int collapse(const std::vector<Node>& binary, int binaryIndex, int depth);
+    void setSlot(WideNode<Width>& node, int slot, AABB const& aabb, int child, int triangleCount);
+
+    std::vector<WideNode<Width>> nodes;
+    std::vector<int> triangleIndices;
+    int maxDepth = 0;
+};
+
+using WideBVH4 = WideBVH<4>;
+using WideBVH8 = WideBVH<8>;
@@ -20,18 +20,31 @@ uniform ivec2 texGeometrySize;
 
 #define REINTERPRET_FLOAT_DATA
 
+// STACK_SIZE is injected by ShaderProgram for every format with a traversal stack,
+// BVH_WIDTH (4 or 8) and BVH_QUANTIZED (8 or 16 bit planes) for the wide node formats,
+// BVH_SKIP_LINKS and BVH_NODE_END for the stackless one,
+// BVH_DEPTH_FIRST, BVH_LEAF_COUNT_BITS and BVH_INDEX_BEGIN for depth-first nodes with implicit left child,
+// NODE_TILE_WIDTH and NODE_TILE_HEIGHT for binary nodes stored in tiles,
+// BVH_INSTANCED and TOP_STACK_SIZE for a top-level tree over instances of shared binary trees
+
+#ifndef STACK_SIZE
+#define STACK_SIZE 15
+#endif
+
 //------------------- STACK -----------------------
 
 int countTI = 0;
-int _stack[15];
+int _stack[STACK_SIZE];
 int _index = -1;
 void stackClear() { _index = -1; }
 int stackSize() { return _index + 1; }
-void stackPush(in int node) { if(_index > 14) discard; _stack[++_index] = node; }
+void stackPush(in int node) { if(_index > STACK_SIZE - 2) discard; _stack[++_index] = node; }
 int stackPop() { return _stack[_index--]; }
 
 //------------------- STRUCTS -----------------------
 
+// inner node: leftChild, rightChild - pixel index of child nodes
+// leaf: leftChild - pixel index of the first triangle, rightChild - minus triangle count
 struct Node
 {
     int leftChild;
@@ -74,25 +87,60 @@ struct IndexedTriangle
 
 //------------------- GETTERS -----------------------
 
-vec4 getData(int index)
+vec4 getTexel(int x, int y)
 {
-    int x = index % texGeometrySize.x;
-    int y = index / texGeometrySize.x;
     vec2 uvPos = vec2(x / float(texGeometrySize.x), y / float(texGeometrySize.y));
     return texture(texGeometry, uvPos);
 }
 
+vec4 getData(int index)
+{
+    return getTexel(index % texGeometrySize.x, index / texGeometrySize.x);
+}
+
+#ifdef NODE_TILE_WIDTH
+// node section in NODE_TILE_WIDTH x NODE_TILE_HEIGHT texel tiles, tiles fill texture rows (ClusteredBVH)
+vec4 getNodeData(int index)
+{
+    const int tileSize = NODE_TILE_WIDTH * NODE_TILE_HEIGHT;
+    int tile = index / tileSize;
+    int inTile = index % tileSize;
+    int tilesPerRow = texGeometrySize.x / NODE_TILE_WIDTH;
+    return getTexel((tile % tilesPerRow) * NODE_TILE_WIDTH + inTile % NODE_TILE_WIDTH,
+                    (tile / tilesPerRow) * NODE_TILE_HEIGHT + inTile / NODE_TILE_WIDTH);
+}
+#else
+vec4 getNodeData(int index) { return getData(index); }
+#endif
+
 Node getNode(int index)
 {
-    vec4 data0 = getData(index + 0);
-    vec4 data1 = getData(index + 1);
+    vec4 data0 = getNodeData(index + 0);
+    vec4 data1 = getNodeData(index + 1);
 
     Node node;
 
+#if defined(BVH_DEPTH_FIRST)
+    // the left child follows its parent, the only link is the right child or the packed leaf range
 #ifdef REINTERPRET_FLOAT_DATA
+    int link = floatBitsToInt(data0.r);
+#else
+    int link = int(data0.r);
+#endif
+    if(link < 0)
+    {
+        node.leftChild = BVH_INDEX_BEGIN + ((-link) >> BVH_LEAF_COUNT_BITS);
+        node.rightChild = -((-link) & ((1 << BVH_LEAF_COUNT_BITS) - 1));
+    }
+    else
+    {
+        node.leftChild = index + 2;
+        node.rightChild = link;
+    }
+#elif defined(REINTERPRET_FLOAT_DATA)
     node.leftChild = floatBitsToInt(data0.r);
     node.rightChild = floatBitsToInt(data0.g);
- #else
+#else
     node.leftChild = int(data0.r);
     node.rightChild = int(data0.g);
 #endif
@@ -189,11 +237,12 @@ bool isect_tri(inout Ray ray, in IndexedTriangle tri, inout Hit hit) {
 
 //------------------- TRACE -----------------------
 
-void traceCloseHitV2(inout Ray ray, inout Hit hit)
+// binary tree with the root at pixel root, hit.isHit is left as is when nothing closer is found,
+// anyHit - returns at the first hit (occlusion), constant at every call site
+void traceBinaryTree(inout Ray ray, inout Hit hit, int root, bool anyHit)
 {
     stackClear();
-    stackPush(0);
-    hit.isHit = false;
+    stackPush(root);
     Node select;
     IndexedTriangle try;
     float tempt;
@@ -206,57 +255,356 @@ void traceCloseHitV2(inout Ray ray, inout Hit hit)
         select = getNode(stackPop());
         if(!slabs(ray, select.aabbMin, select.aabbMax, tempt))
             continue;
-        
-        if(select.leftChild > 0 && select.rightChild > 0)
+
+        if(select.rightChild < 0) // leaf, contiguous triangles
         {
-            float leftMinT = 0;
-            float rightMinT = 0;
-            Node right = getNode(select.rightChild);
-            Node left = getNode(select.leftChild);
-            bool rightI = slabs(ray, right.aabbMin, right.aabbMax,  rightMinT);
-            bool leftI = slabs(ray, left.aabbMin, left.aabbMax,  leftMinT);
-
-            if(rightI && leftI)
+            for(int t = 0; t < -select.rightChild; t++)
             {
-                if (rightMinT < leftMinT)
-                {
-                    stackPush(select.leftChild);
-                    stackPush(select.rightChild);
-                }
-                else
-                {
-                    stackPush(select.rightChild);
-                    stackPush(select.leftChild);
-                }
-                continue;
+                try = getIndexedTriangle(select.leftChild + t);
+                if(isect_tri(ray, try, hit) && anyHit)
+                    return;
             }
-            if(rightI)
+            continue;
+        }
+
+        float leftMinT = 0;
+        float rightMinT = 0;
+        Node right = getNode(select.rightChild);
+        Node left = getNode(select.leftChild);
+        bool rightI = slabs(ray, right.aabbMin, right.aabbMax,  rightMinT);
+        bool leftI = slabs(ray, left.aabbMin, left.aabbMax,  leftMinT);
+
+        if(rightI && leftI)
+        {
+            if (rightMinT < leftMinT)
+            {
+                stackPush(select.leftChild);
                 stackPush(select.rightChild);
+            }
             else
+            {
+                stackPush(select.rightChild);
                 stackPush(select.leftChild);
+            }
             continue;
         }
-
-        if (select.rightChild > 0)
+        if(rightI)
             stackPush(select.rightChild);
-
-        if (select.leftChild > 0)
+        else if(leftI)
             stackPush(select.leftChild);
+    }
+}
+
+void traceCloseHitV2(inout Ray ray, inout Hit hit)
+{
+    hit.isHit = false;
+    traceBinaryTree(ray, hit, 0, false);
+}
+
+#ifdef BVH_INSTANCED
+// top-level binary tree at pixel 0, its leaves point to instance records of 4 pixels:
+// 3 rows of the world to object matrix, then bottom-level root pixel and instance index
+int _topStack[TOP_STACK_SIZE];
+int _topIndex = -1;
+void topStackPush(in int node) { if(_topIndex > TOP_STACK_SIZE - 2) discard; _topStack[++_topIndex] = node; }
+int topStackPop() { return _topStack[_topIndex--]; }
+
+void traceInstance(inout Ray ray, inout Hit hit, int record, bool anyHit)
+{
+    vec4 row0 = getData(record + 0);
+    vec4 row1 = getData(record + 1);
+    vec4 row2 = getData(record + 2);
+#ifdef REINTERPRET_FLOAT_DATA
+    int root = floatBitsToInt(getData(record + 3).r);
+#else
+    int root = int(getData(record + 3).r);
+#endif
+
+    // not normalized, so t is the same in both spaces
+    Ray local = ray;
+    vec4 origin = vec4(ray.origin, 1.0);
+    local.origin = vec3(dot(row0, origin), dot(row1, origin), dot(row2, origin));
+    local.direction = vec3(dot(row0.xyz, ray.direction), dot(row1.xyz, ray.direction), dot(row2.xyz, ray.direction));
+
+    Hit localHit;
+    localHit.isHit = false;
+    traceBinaryTree(local, localHit, root, anyHit);
+    #ifdef debugShowBVH
+    ray.nodesVisited = local.nodesVisited;
+    #endif
+    if(!localHit.isHit)
+        return;
+
+    // normals go back with the transpose of the world to object matrix
+    ray.tEnd = local.tEnd;
+    hit = localHit;
+    hit.position = ray.origin + ray.direction * ray.tEnd;
+    hit.normal = normalize(mat3(row0.xyz, row1.xyz, row2.xyz) * localHit.normal);
+}
 
-        if(select.rightChild <= 0)
+void traceInstancedTree(inout Ray ray, inout Hit hit, bool anyHit)
+{
+    _topIndex = -1;
+    topStackPush(0);
+    hit.isHit = false;
+    float tempt;
+
+    for(int i = 0; (i < 1024) && (_topIndex >= 0); i++)
+    {
+        #ifdef debugShowBVH
+        ray.nodesVisited++;
+        #endif
+        Node select = getNode(topStackPop());
+        if(!slabs(ray, select.aabbMin, select.aabbMax, tempt))
+            continue;
+
+        if(select.rightChild < 0) // leaf, contiguous instance records
         {
-            try = getIndexedTriangle(-select.rightChild);
-            isect_tri(ray, try, hit);
+            for(int t = 0; t < -select.rightChild; t++)
+            {
+                traceInstance(ray, hit, select.leftChild + t * 4, anyHit);
+                if(anyHit && hit.isHit)
+                    return;
+            }
+            continue;
         }
 
-        if(select.leftChild <= 0)
+        float leftMinT = 0;
+        float rightMinT = 0;
+        Node right = getNode(select.rightChild);
+        Node left = getNode(select.leftChild);
+        bool rightI = slabs(ray, right.aabbMin, right.aabbMax, rightMinT);
+        bool leftI = slabs(ray, left.aabbMin, left.aabbMax, leftMinT);
+
+        if(rightI && leftI)
         {
-            try = getIndexedTriangle(-select.leftChild);
-            isect_tri(ray, try, hit);
+            if (rightMinT < leftMinT)
+            {
+                topStackPush(select.leftChild);
+                topStackPush(select.rightChild);
+            }
+            else
+            {
+                topStackPush(select.rightChild);
+                topStackPush(select.leftChild);
+            }
+            continue;
         }
+        if(rightI)
+            topStackPush(select.rightChild);
+        else if(leftI)
+            topStackPush(select.leftChild);
     }
 }
 
+void traceCloseHitInstanced(inout Ray ray, inout Hit hit)
+{
+    traceInstancedTree(ray, hit, false);
+}
+#endif
+
+#ifdef BVH_WIDTH
+// 4 children of a wide node, child: pixel of inner node or of the first leaf triangle, -1 - empty slot
+struct WideGroup
+{
+    vec4 minX, minY, minZ;
+    vec4 maxX, maxY, maxZ;
+    ivec4 child;
+    ivec4 count;
+};
+
+#ifdef BVH_QUANTIZED
+#ifndef REINTERPRET_FLOAT_DATA
+#error "Quantized nodes store packed integers"
+#endif
+#define BVH_GROUPS 1
+
+// quantized node: [origin.xyz, exponents][child x4][min x/y/z, max x/y/z codes][triangle counts, 8 bit each]
+// plane = origin + code * 2^(exponent - 127), planes are rounded outwards on CPU
+vec4 unpack8(uint word) { return vec4(uvec4(word, word >> 8, word >> 16, word >> 24) & 0xFFu); }
+vec4 unpack16(uint low, uint high) { return vec4(uvec4(low, low >> 16, high, high >> 16) & 0xFFFFu); }
+
+WideGroup getWideGroup(int node, int group)
+{
+    vec4 header = getData(node);
+    uint exponents = floatBitsToUint(header.w);
+    vec3 scale = uintBitsToFloat(((uvec3(exponents, exponents >> 8, exponents >> 16) & 0xFFu) << 23));
+
+    WideGroup g;
+    g.child = floatBitsToInt(getData(node + 1));
+#if BVH_QUANTIZED == 8
+    uvec4 w0 = floatBitsToUint(getData(node + 2)); // minX minY minZ maxX
+    uvec4 w1 = floatBitsToUint(getData(node + 3)); // maxY maxZ counts
+    g.minX = header.x + unpack8(w0.x) * scale.x;
+    g.minY = header.y + unpack8(w0.y) * scale.y;
+    g.minZ = header.z + unpack8(w0.z) * scale.z;
+    g.maxX = header.x + unpack8(w0.w) * scale.x;
+    g.maxY = header.y + unpack8(w1.x) * scale.y;
+    g.maxZ = header.z + unpack8(w1.y) * scale.z;
+    g.count = ivec4(unpack8(w1.z));
+#else
+    uvec4 w0 = floatBitsToUint(getData(node + 2)); // minX minY
+    uvec4 w1 = floatBitsToUint(getData(node + 3)); // minZ maxX
+    uvec4 w2 = floatBitsToUint(getData(node + 4)); // maxY maxZ
+    uint counts = floatBitsToUint(getData(node + 5).r);
+    g.minX = header.x + unpack16(w0.x, w0.y) * scale.x;
+    g.minY = header.y + unpack16(w0.z, w0.w) * scale.y;
+    g.minZ = header.z + unpack16(w1.x, w1.y) * scale.z;
+    g.maxX = header.x + unpack16(w1.z, w1.w) * scale.x;
+    g.maxY = header.y + unpack16(w2.x, w2.y) * scale.y;
+    g.maxZ = header.z + unpack16(w2.z, w2.w) * scale.z;
+    g.count = ivec4(unpack8(counts));
+#endif
+    return g;
+}
+#else
+#define BVH_GROUPS (BVH_WIDTH / 4)
+
+// wide node: BVH_WIDTH / 4 groups of 8 pixels - minX, minY, minZ, maxX, maxY, maxZ, child, triangle count
+WideGroup getWideGroup(int node, int group)
+{
+    int base = node + group * 8;
+    WideGroup g;
+    g.minX = getData(base + 0);
+    g.minY = getData(base + 1);
+    g.minZ = getData(base + 2);
+    g.maxX = getData(base + 3);
+    g.maxY = getData(base + 4);
+    g.maxZ = getData(base + 5);
+#ifdef REINTERPRET_FLOAT_DATA
+    g.child = floatBitsToInt(getData(base + 6));
+    g.count = floatBitsToInt(getData(base + 7));
+#else
+    g.child = ivec4(getData(base + 6));
+    g.count = ivec4(getData(base + 7));
+#endif
+    return g;
+}
+#endif
+
+void traceWideTree(inout Ray ray, inout Hit hit, bool anyHit)
+{
+    stackClear();
+    stackPush(0);
+    hit.isHit = false;
+    vec3 invDir = 1.0 / ray.direction;
+
+    for(int i = 0; (i < 1024) && (stackSize() > 0); i++)
+    {
+        #ifdef debugShowBVH
+        ray.nodesVisited++;
+        #endif
+        int node = stackPop();
+
+        // inner children hit by the ray, sorted far to near
+        int innerChild[BVH_WIDTH];
+        float innerT[BVH_WIDTH];
+        int innerCount = 0;
+
+        for(int group = 0; group < BVH_GROUPS; group++)
+        {
+            WideGroup g = getWideGroup(node, group);
+            vec4 t0x = (g.minX - ray.origin.x) * invDir.x;
+            vec4 t0y = (g.minY - ray.origin.y) * invDir.y;
+            vec4 t0z = (g.minZ - ray.origin.z) * invDir.z;
+            vec4 t1x = (g.maxX - ray.origin.x) * invDir.x;
+            vec4 t1y = (g.maxY - ray.origin.y) * invDir.y;
+            vec4 t1z = (g.maxZ - ray.origin.z) * invDir.z;
+
+            vec4 tNear = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), vec4(ray.tStart)));
+            vec4 tFar = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), vec4(ray.tEnd)));
+
+            for(int c = 0; c < 4; c++)
+            {
+                if(g.child[c] < 0 || tNear[c] > tFar[c])
+                    continue;
+
+                if(g.count[c] > 0) // leaf, contiguous triangles
+                {
+                    for(int t = 0; t < g.count[c]; t++)
+                        if(isect_tri(ray, getIndexedTriangle(g.child[c] + t), hit) && anyHit)
+                            return;
+                    continue;
+                }
+
+                int j = innerCount++;
+                for(; j > 0 && innerT[j - 1] < tNear[c]; j--)
+                {
+                    innerChild[j] = innerChild[j - 1];
+                    innerT[j] = innerT[j - 1];
+                }
+                innerChild[j] = g.child[c];
+                innerT[j] = tNear[c];
+            }
+        }
+
+        // nearest is pushed last and popped first
+        for(int c = 0; c < innerCount; c++)
+            if(innerT[c] < ray.tEnd)
+                stackPush(innerChild[c]);
+    }
+}
+
+void traceCloseHitWide(inout Ray ray, inout Hit hit)
+{
+    traceWideTree(ray, hit, false);
+}
+#endif
+
+#ifdef BVH_SKIP_LINKS
+// nodes in preorder, inner: leftChild - pixel of the node after the subtree (skip), rightChild - 0
+// leaf: leftChild - pixel of the first triangle, rightChild - minus triangle count, continues with the next node
+void traceSkipLinks(inout Ray ray, inout Hit hit, bool anyHit)
+{
+    hit.isHit = false;
+    int node = 0;
+    float tempt;
+
+    for(int i = 0; (i < 4096) && (node < BVH_NODE_END); i++)
+    {
+        #ifdef debugShowBVH
+        ray.nodesVisited++;
+        #endif
+        Node select = getNode(node);
+        bool isBoxHit = slabs(ray, select.aabbMin, select.aabbMax, tempt);
+
+        if(select.rightChild < 0) // leaf, contiguous triangles
+        {
+            if(isBoxHit)
+                for(int t = 0; t < -select.rightChild; t++)
+                    if(isect_tri(ray, getIndexedTriangle(select.leftChild + t), hit) && anyHit)
+                        return;
+            node += 2;
+        }
+        else
+            node = isBoxHit ? node + 2 : select.leftChild;
+    }
+}
+
+void traceCloseHitStackless(inout Ray ray, inout Hit hit)
+{
+    traceSkipLinks(ray, hit, false);
+}
+#endif
+
+// any hit in (tStart, tEnd) on the current node layout, for shadow, ambient occlusion and visibility rays:
+// traversal stops at the first intersection, no closest hit search
+bool traceOcclusion(Ray ray)
+{
+    Hit hit;
+    hit.isHit = false;
+    #if defined(BVH_INSTANCED)
+    traceInstancedTree(ray, hit, true);
+    #elif defined(BVH_SKIP_LINKS)
+    traceSkipLinks(ray, hit, true);
+    #elif defined(BVH_WIDTH)
+    traceWideTree(ray, hit, true);
+    #else
+    traceBinaryTree(ray, hit, 0, true);
+    #endif
+    return hit.isHit;
+}
+
 void main() {
     vec3 viewDir = normalize(vec3((gl_FragCoord.xy - screeResolution.xy * 0.5) / screeResolution.y, 1.0));
     vec3 worldDir = viewToWorld * viewDir;
@@ -271,7 +619,15 @@ void main() {
     #endif
 
     Hit hit;
+    #if defined(BVH_INSTANCED)
+    traceCloseHitInstanced(ray, hit);
+    #elif defined(BVH_SKIP_LINKS)
+    traceCloseHitStackless(ray, hit);
+    #elif defined(BVH_WIDTH)
+    traceCloseHitWide(ray, hit);
+    #else
     traceCloseHitV2(ray, hit);
+    #endif
     color = vec4(hit.normal * .5 + 0.5, 1.0);
 
     #ifdef debugShowBVH
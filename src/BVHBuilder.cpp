@@ -1,57 +1,237 @@
 #include "BVHBuilder.h"
 #include <Utils.h>
 #include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <glm.hpp>
-#include <stack>
 using glm::vec3;
 
-BVHBuilder::BVHBuilder() { }
+namespace {
+// reductions over bigger ranges are split to chunks of this size and run in parallel,
+// chunking does not depend on thread count, so results are the same for any threadCount
+constexpr int parallelGrainSize = 16 * 1024;
+
+// smaller subtrees are built by the task of their parent
+constexpr int taskSpawnSize = 1024;
+
+// refit knows no subtree sizes, so the upper levels are split to tasks (up to 2^depth tasks)
+constexpr int refitTaskDepth = 10;
+
+struct RangeBounds {
+    AABB aabb = AABB::empty();
+    AABB centroidBounds = AABB::empty();
+    vec3 centerSum = vec3(0);
+};
+
+struct Bin {
+    AABB aabb = AABB::empty();
+    int count = 0;
+    float weight = 0.0f; // sum of triangle weights, count without them
+};
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// insert two zero bits after each of the lower 10 bits
+uint64_t expandBits10(uint64_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// insert two zero bits after each of the lower 21 bits
+uint64_t expandBits21(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+}
+
+BVHBuilder::BVHBuilder()
+    : BVHBuilder(BVHBuildSettings())
+{
+}
+
+BVHBuilder::BVHBuilder(BVHBuildSettings const& settings)
+    : settings(settings)
+    , threadPool(std::make_unique<ThreadPool>(settings.threadCount))
+{
+}
 
 void BVHBuilder::build(const Model3D& model)
 {
-    size_t nodeSize = sizeof(Node);
-    nodeList.push_back(Node());
+    const Clock::time_point buildStart = Clock::now();
+    const int triangleCount = (int)model.triangles.size();
+    triangleIndices.resize(triangleCount);
+    triangleBounds.resize(triangleCount);
+    triangleCenters.resize(triangleCount);
 
     const auto& v = model.vertices;
-    for (int i = 0; i < model.triangles.size(); ++i) {
-        const int i0 = model.triangles[i].x;
-        const int i1 = model.triangles[i].y;
-        const int i2 = model.triangles[i].z;
-        vecTriangle.emplace_back(v[i0].position, v[i1].position, v[i2].position, i, model.triangles[i]);
+    threadPool->parallelFor(0, triangleCount, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+        for (int i = chunkBegin; i < chunkEnd; ++i) {
+            const vec3& p0 = v[model.triangles[i].x].position;
+            const vec3& p1 = v[model.triangles[i].y].position;
+            const vec3& p2 = v[model.triangles[i].z].position;
+            triangleIndices[i] = i;
+            triangleBounds[i] = AABB(glm::min(glm::min(p0, p1), p2), glm::max(glm::max(p0, p1), p2));
+            triangleCenters[i] = (p0 + p1 + p2) / 3.0f;
+        }
+    });
+
+    buildHierarchy(&model, millisecondsSince(buildStart));
+}
+
+void BVHBuilder::build(const std::vector<AABB>& primitiveBounds)
+{
+    const Clock::time_point buildStart = Clock::now();
+    const int primitiveCount = (int)primitiveBounds.size();
+    triangleIndices.resize(primitiveCount);
+    triangleBounds = primitiveBounds;
+    triangleCenters.resize(primitiveCount);
+
+    threadPool->parallelFor(0, primitiveCount, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+        for (int i = chunkBegin; i < chunkEnd; ++i) {
+            triangleIndices[i] = i;
+            triangleCenters[i] = (primitiveBounds[i].getMin() + primitiveBounds[i].getMax()) * 0.5f;
+        }
+    });
+
+    buildHierarchy(nullptr, millisecondsSince(buildStart));
+}
+
+void BVHBuilder::buildHierarchy(const Model3D* model, double boundsMilliseconds)
+{
+    const int triangleCount = (int)triangleIndices.size();
+    modelTriangleCount = triangleCount;
+    nodeList.clear();
+    buildTimings = BVHBuildTimings();
+    buildTimings.bounds = boundsMilliseconds;
+    buildTimings.total = boundsMilliseconds;
+    if (triangleCount == 0)
+        return;
+
+    // full binary tree with at least one triangle per leaf
+    nodeList.resize(2 * triangleCount - 1);
+    nodeCount = 1;
+    const Clock::time_point hierarchyStart = Clock::now();
+    Clock::time_point phaseStart = hierarchyStart;
+
+    if (settings.splitMethod == BVHSplitMethod::LBVH || settings.splitMethod == BVHSplitMethod::PLOC) {
+        std::vector<AABB> chunks((triangleCount + parallelGrainSize - 1) / parallelGrainSize, AABB::empty());
+        threadPool->parallelFor(0, triangleCount, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+            AABB& chunk = chunks[chunkBegin / parallelGrainSize];
+            for (int i = chunkBegin; i < chunkEnd; ++i)
+                chunk.surrounding(triangleCenters[i]);
+        });
+        AABB centroidBounds = AABB::empty();
+        for (AABB const& chunk : chunks)
+            centroidBounds.surrounding(chunk);
+
+        sortByMortonCode(centroidBounds);
+        buildTimings.sort = millisecondsSince(phaseStart);
+        phaseStart = Clock::now();
+        if (settings.splitMethod == BVHSplitMethod::PLOC) {
+            buildPLOC();
+            collapseLeaves();
+        } else {
+            buildMortonRecursive(0, 0, triangleCount);
+        }
+        std::vector<uint64_t>().swap(mortonCodes);
+    } else if (settings.splitMethod == BVHSplitMethod::SBVH && model) {
+        maxReferenceCount = triangleCount + int(triangleCount * std::max(settings.spatialSplitBudget, 0.0f));
+        referenceCount = triangleCount;
+        leafReferenceCount = 0;
+        nodeList.resize(2 * maxReferenceCount - 1);
+        triangleIndices.resize(maxReferenceCount);
+
+        std::vector<TriangleReference> refs(triangleCount);
+        AABB rootBounds = AABB::empty();
+        for (int i = 0; i < triangleCount; ++i) {
+            refs[i] = { i, triangleBounds[i] };
+            rootBounds.surrounding(triangleBounds[i]);
+        }
+        spatialModel = model;
+        spatialRootArea = rootBounds.surfaceArea();
+
+        buildSpatialRecursive(0, refs, 0);
+        triangleIndices.resize(leafReferenceCount);
+        spatialModel = nullptr;
+    } else {
+        buildRecurcive(0, 0, triangleCount);
     }
+    nodeList.resize(nodeCount);
+    buildTimings.hierarchy = millisecondsSince(phaseStart);
 
-    nodeList.reserve(vecTriangle.size());
-    buildRecurcive(0, vecTriangle);
+    // PLOC output is depth-first already
+    if (settings.deterministic && settings.splitMethod != BVHSplitMethod::PLOC) {
+        phaseStart = Clock::now();
+        reorderDepthFirst();
+        buildTimings.reorder = millisecondsSince(phaseStart);
+    }
+
+    // only the node list and triangle order are needed after build
+    std::vector<AABB>().swap(triangleBounds);
+    std::vector<vec3>().swap(triangleCenters);
+    buildTimings.total += millisecondsSince(hierarchyStart);
 }
 
-void BVHBuilder::buildRecurcive(int nodeIndex, std::vector<Triangle> const& vecTriangle)
+void BVHBuilder::buildRecurcive(int nodeIndex, int begin, int end)
 {
-    // Build Bpun box for triangles in vecTriangle
-    AABB tempaabb = vecTriangle[0].getAABB();
-    for (Triangle const& tri : vecTriangle)
-        tempaabb.surrounding(tri.getAABB());
+    const int count = end - begin;
+
+    // Build Bpun box for triangles in range, and bound box of their centers for split
+    auto reduceBounds = [&](int chunkBegin, int chunkEnd, RangeBounds& bounds) {
+        for (int i = chunkBegin; i < chunkEnd; ++i) {
+            const int t = triangleIndices[i];
+            bounds.aabb.surrounding(triangleBounds[t]);
+            bounds.centroidBounds.surrounding(triangleCenters[t]);
+            bounds.centerSum += triangleCenters[t];
+        }
+    };
+
+    RangeBounds bounds;
+    if (count > parallelGrainSize) {
+        std::vector<RangeBounds> chunks((count + parallelGrainSize - 1) / parallelGrainSize);
+        threadPool->parallelFor(begin, end, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+            reduceBounds(chunkBegin, chunkEnd, chunks[(chunkBegin - begin) / parallelGrainSize]);
+        });
+        for (RangeBounds const& chunk : chunks) {
+            bounds.aabb.surrounding(chunk.aabb);
+            bounds.centroidBounds.surrounding(chunk.centroidBounds);
+            bounds.centerSum += chunk.centerSum;
+        }
+    } else {
+        reduceBounds(begin, end, bounds);
+    }
+
+    const AABB& centroidBounds = bounds.centroidBounds;
+    const vec3& centerSum = bounds.centerSum;
 
     Node& node = nodeList[nodeIndex];
-    node.aabb = tempaabb;
+    node.aabb = bounds.aabb;
 
-    if (vecTriangle.size() == 2) {
-        node.leftChild = -vecTriangle[0].getIndex();
-        node.rightChild = -vecTriangle[1].getIndex();
+    const int maxLeafSize = std::max(settings.maxLeafSize, 1);
+    if (count == 1) {
+        node.setLeaf(begin, count);
         return;
     }
 
     // seach max dimenson for split
-    vec3 maxVec = vecTriangle[0].getCenter();
-    vec3 minVec = vecTriangle[0].getCenter();
-    vec3 centerSum(0, 0, 0);
-
-    for (Triangle const& tri : vecTriangle) {
-        maxVec = glm::max(tri.getCenter(), maxVec);
-        minVec = glm::min(tri.getCenter(), minVec);
-        centerSum += tri.getCenter();
-    }
-    vec3 midPoint = centerSum / (float)vecTriangle.size();
-    vec3 len = glm::abs(maxVec - minVec);
+    vec3 midPoint = centerSum / (float)count;
+    vec3 len = glm::abs(centroidBounds.getMax() - centroidBounds.getMin());
 
     int axis = 0;
 
@@ -61,48 +241,916 @@ void BVHBuilder::buildRecurcive(int nodeIndex, std::vector<Triangle> const& vecT
     if (len.z > len.y && len.z > len.x)
         axis = 2;
 
-    std::vector<Triangle> tempLeftTriangleList;
-    std::vector<Triangle> tempRightTriangleList;
+    int splitBin = 0;
+    float splitCost = 0.0f;
+    // SBVH over primitive bounds has no triangles to clip, it is plain binned SAH
+    const bool useSAH = (settings.splitMethod == BVHSplitMethod::BinnedSAH
+                            || (settings.splitMethod == BVHSplitMethod::SBVH && !spatialModel))
+        && findBinnedSAHSplit(begin, end, centroidBounds, axis, splitBin, splitCost);
+
+    // small ranges become a leaf, with SAH only when it is not more expensive than the best split
+    if (count <= maxLeafSize) {
+        const float parentArea = node.aabb.surfaceArea();
+        const float leafCost = settings.intersectionCost * count;
+        const bool leafIsCheaper = !useSAH || parentArea <= 0.0f
+            || leafCost <= settings.traversalCost + settings.intersectionCost * splitCost / parentArea;
+
+        if (leafIsCheaper) {
+            node.setLeaf(begin, count);
+            return;
+        }
+    }
+
+    auto first = triangleIndices.begin() + begin;
+    auto last = triangleIndices.begin() + end;
+    auto middle = first;
+
+    if (useSAH) {
+        const int binCount = std::max(settings.sahBinCount, 2);
+        const float binScale = binCount / len[axis];
+        const float binMin = centroidBounds.getMin()[axis];
+        middle = std::partition(first, last, [&](int t) {
+            return std::min(int((triangleCenters[t][axis] - binMin) * binScale), binCount - 1) <= splitBin;
+        });
+    } else {
+        middle = std::partition(first, last, [&](int t) {
+            return triangleCenters[t][axis] < midPoint[axis];
+        });
+    }
+
+    // all centroids are equal, split range at the median
+    if (middle == first || middle == last) {
+        middle = first + count / 2;
+        std::nth_element(first, middle, last, [&](int a, int b) {
+            return triangleCenters[a][axis] < triangleCenters[b][axis];
+        });
+    }
+
+    const int split = int(middle - triangleIndices.begin());
+
+    // nodeList is allocated for the whole tree, so node references stay valid
+    ThreadPool::TaskGroup group(*threadPool);
+
+    const int leftIndex = nodeCount++;
+    const int rightIndex = nodeCount++;
+    node.leftChild = leftIndex;
+    node.rightChild = rightIndex;
 
-    auto splitByAxis = [&](std::function<float(vec3 const& point)> getElement) {
-        for (Triangle const& tri : vecTriangle) {
-            if (getElement(tri.getCenter()) < getElement(midPoint))
-                tempLeftTriangleList.push_back(tri);
+    if (count >= taskSpawnSize)
+        group.run([this, leftIndex, begin, split] { buildRecurcive(leftIndex, begin, split); });
+    else
+        buildRecurcive(leftIndex, begin, split);
+
+    buildRecurcive(rightIndex, split, end);
+    group.wait();
+}
+
+bool BVHBuilder::findBinnedSAHSplit(int begin, int end, AABB const& centroidBounds,
+    int& axis, int& splitBin, float& splitCost) const
+{
+    const int binCount = std::max(settings.sahBinCount, 2);
+    const int count = end - begin;
+    const vec3 extent = centroidBounds.getMax() - centroidBounds.getMin();
+    const vec3 binMin = centroidBounds.getMin();
+    vec3 binScale;
+    for (int a = 0; a < 3; ++a)
+        binScale[a] = (extent[a] > 0.0f) ? binCount / extent[a] : 0.0f;
+
+    const bool weighted = triangleWeights.size() == triangleBounds.size();
+
+    // bins of all 3 axes in one pass: bins[axis * binCount + bin]
+    auto binRange = [&](int chunkBegin, int chunkEnd, Bin* bins) {
+        for (int i = chunkBegin; i < chunkEnd; ++i) {
+            const int t = triangleIndices[i];
+            const float weight = weighted ? triangleWeights[t] : 1.0f;
+            for (int a = 0; a < 3; ++a) {
+                int b = std::min(int((triangleCenters[t][a] - binMin[a]) * binScale[a]), binCount - 1);
+                bins[a * binCount + b].aabb.surrounding(triangleBounds[t]);
+                bins[a * binCount + b].count++;
+                bins[a * binCount + b].weight += weight;
+            }
+        }
+    };
+
+    std::vector<Bin> bins(3 * binCount);
+    if (count > parallelGrainSize) {
+        const int chunkCount = (count + parallelGrainSize - 1) / parallelGrainSize;
+        std::vector<Bin> chunkBins(chunkCount * 3 * binCount);
+        threadPool->parallelFor(begin, end, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+            binRange(chunkBegin, chunkEnd, &chunkBins[(chunkBegin - begin) / parallelGrainSize * 3 * binCount]);
+        });
+        for (int c = 0; c < chunkCount; ++c) {
+            for (int b = 0; b < 3 * binCount; ++b) {
+                bins[b].aabb.surrounding(chunkBins[c * 3 * binCount + b].aabb);
+                bins[b].count += chunkBins[c * 3 * binCount + b].count;
+                bins[b].weight += chunkBins[c * 3 * binCount + b].weight;
+            }
+        }
+    } else {
+        binRange(begin, end, bins.data());
+    }
+
+    std::vector<float> rightArea(binCount);
+    std::vector<int> rightCount(binCount);
+    std::vector<float> rightWeight(binCount);
+
+    // costs are relative, so SA(parent) and Ct are dropped: cost = SA(L) * W(L) + SA(R) * W(R),
+    // W is the triangle count without weights
+    float bestCost = FLT_MAX;
+    for (int a = 0; a < 3; ++a) {
+        if (extent[a] <= 0.0f)
+            continue;
+
+        const Bin* axisBins = &bins[a * binCount];
+
+        // sweep from the right, rightArea[i] / rightCount[i] describe bins (i, binCount)
+        AABB accum = AABB::empty();
+        int accumCount = 0;
+        float accumWeight = 0.0f;
+        for (int i = binCount - 1; i > 0; --i) {
+            accum.surrounding(axisBins[i].aabb);
+            accumCount += axisBins[i].count;
+            accumWeight += axisBins[i].weight;
+            rightArea[i - 1] = accum.surfaceArea();
+            rightCount[i - 1] = accumCount;
+            rightWeight[i - 1] = accumWeight;
+        }
+
+        accum = AABB::empty();
+        accumCount = 0;
+        accumWeight = 0.0f;
+        for (int i = 0; i < binCount - 1; ++i) {
+            accum.surrounding(axisBins[i].aabb);
+            accumCount += axisBins[i].count;
+            accumWeight += axisBins[i].weight;
+            if (accumCount == 0 || rightCount[i] == 0)
+                continue;
+
+            float cost = accum.surfaceArea() * accumWeight + rightArea[i] * rightWeight[i];
+            if (cost < bestCost) {
+                bestCost = cost;
+                axis = a;
+                splitBin = i;
+            }
+        }
+    }
+
+    splitCost = bestCost;
+    if (weighted && bestCost < FLT_MAX) {
+        float parentWeight = 0.0f;
+        for (int b = 0; b < binCount; ++b)
+            parentWeight += bins[b].weight;
+        splitCost = parentWeight > 0.0f ? bestCost * count / parentWeight : 0.0f;
+    }
+    return bestCost < FLT_MAX;
+}
+
+void BVHBuilder::sortByMortonCode(AABB const& centroidBounds)
+{
+    const int count = (int)triangleIndices.size();
+    const bool wideCodes = settings.mortonBits > 30;
+    const int axisBits = wideCodes ? 21 : 10;
+    const float axisMax = float((1 << axisBits) - 1);
+
+    const vec3 extent = centroidBounds.getMax() - centroidBounds.getMin();
+    vec3 scale;
+    for (int a = 0; a < 3; ++a)
+        scale[a] = (extent[a] > 0.0f) ? axisMax / extent[a] : 0.0f;
+
+    std::vector<uint64_t> keys(count);
+    threadPool->parallelFor(0, count, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+        for (int i = chunkBegin; i < chunkEnd; ++i) {
+            vec3 q = glm::clamp((triangleCenters[i] - centroidBounds.getMin()) * scale, 0.0f, axisMax);
+            uint64_t x = uint64_t(q.x), y = uint64_t(q.y), z = uint64_t(q.z);
+            keys[i] = wideCodes
+                ? (expandBits21(x) << 2) | (expandBits21(y) << 1) | expandBits21(z)
+                : (expandBits10(x) << 2) | (expandBits10(y) << 1) | expandBits10(z);
+        }
+    });
+
+    // LSD radix sort of (key, triangle index), 8 bits per pass,
+    // each chunk histograms its part and scatters it to precomputed offsets, so passes stay stable
+    constexpr int radix = 256;
+    const int passCount = (3 * axisBits + 7) / 8;
+    const int chunkCount = (count + parallelGrainSize - 1) / parallelGrainSize;
+
+    std::vector<uint64_t> keysTemp(count);
+    std::vector<int> indicesTemp(count);
+    std::vector<int> offsets(chunkCount * radix);
+
+    for (int pass = 0; pass < passCount; ++pass) {
+        const int shift = pass * 8;
+        std::fill(offsets.begin(), offsets.end(), 0);
+
+        threadPool->parallelFor(0, count, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+            int* histogram = &offsets[chunkBegin / parallelGrainSize * radix];
+            for (int i = chunkBegin; i < chunkEnd; ++i)
+                histogram[(keys[i] >> shift) & (radix - 1)]++;
+        });
+
+        // exclusive prefix sum, digit major, chunk minor
+        int sum = 0;
+        for (int digit = 0; digit < radix; ++digit) {
+            for (int chunk = 0; chunk < chunkCount; ++chunk) {
+                int& offset = offsets[chunk * radix + digit];
+                const int histogramCount = offset;
+                offset = sum;
+                sum += histogramCount;
+            }
+        }
+
+        threadPool->parallelFor(0, count, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+            int* offset = &offsets[chunkBegin / parallelGrainSize * radix];
+            for (int i = chunkBegin; i < chunkEnd; ++i) {
+                const int destination = offset[(keys[i] >> shift) & (radix - 1)]++;
+                keysTemp[destination] = keys[i];
+                indicesTemp[destination] = triangleIndices[i];
+            }
+        });
+
+        keys.swap(keysTemp);
+        triangleIndices.swap(indicesTemp);
+    }
+
+    mortonCodes = std::move(keys);
+}
+
+AABB BVHBuilder::buildMortonRecursive(int nodeIndex, int begin, int end)
+{
+    const int count = end - begin;
+    Node& node = nodeList[nodeIndex];
+
+    if (count <= std::max(settings.maxLeafSize, 1)) {
+        node.setLeaf(begin, count);
+        node.aabb = AABB::empty();
+        for (int i = begin; i < end; ++i)
+            node.aabb.surrounding(triangleBounds[triangleIndices[i]]);
+        return node.aabb;
+    }
+
+    // split where the highest bit that differs between first and last code flips,
+    // codes are sorted, so binary search for the last code with the first one's prefix
+    const uint64_t firstCode = mortonCodes[begin];
+    const uint64_t lastCode = mortonCodes[end - 1];
+    int split = begin + count / 2; // equal codes, split in the middle
+
+    if (firstCode != lastCode) {
+        uint64_t highestBit = firstCode ^ lastCode;
+        for (int shift = 1; shift < 64; shift <<= 1)
+            highestBit |= highestBit >> shift;
+        highestBit ^= highestBit >> 1;
+
+        int low = begin; // always shares the prefix
+        int high = end - 1; // never shares the prefix
+        while (high - low > 1) {
+            const int middle = (low + high) / 2;
+            if ((firstCode ^ mortonCodes[middle]) < highestBit)
+                low = middle;
             else
-                tempRightTriangleList.push_back(tri);
+                high = middle;
         }
-        assert(tempLeftTriangleList.size());
-        assert(tempRightTriangleList.size());
+        split = high;
+    }
+
+    AABB leftBounds;
+    ThreadPool::TaskGroup group(*threadPool);
+
+    const int leftIndex = nodeCount++;
+    const int rightIndex = nodeCount++;
+    node.leftChild = leftIndex;
+    node.rightChild = rightIndex;
+
+    if (count >= taskSpawnSize)
+        group.run([this, leftIndex, begin, split, &leftBounds] { leftBounds = buildMortonRecursive(leftIndex, begin, split); });
+    else
+        leftBounds = buildMortonRecursive(leftIndex, begin, split);
+
+    AABB rightBounds = buildMortonRecursive(rightIndex, split, end);
+    group.wait();
+
+    node.aabb = leftBounds;
+    node.aabb.surrounding(rightBounds);
+    return node.aabb;
+}
+
+void BVHBuilder::buildPLOC()
+{
+    const int count = (int)triangleIndices.size();
+    const int radius = std::max(settings.plocRadius, 1);
+
+    // leaves take the back of nodeList, one per sorted triangle
+    std::vector<int> clusters(count);
+    std::vector<AABB> clusterBounds(count);
+    threadPool->parallelFor(0, count, parallelGrainSize, [&](int chunkBegin, int chunkEnd) {
+        for (int i = chunkBegin; i < chunkEnd; ++i) {
+            Node& leaf = nodeList[count - 1 + i];
+            leaf.setLeaf(i, 1);
+            leaf.aabb = triangleBounds[triangleIndices[i]];
+            clusters[i] = count - 1 + i;
+            clusterBounds[i] = leaf.aabb;
+        }
+    });
+
+    // a cluster costs radius union areas, so chunks are smaller than for plain reductions
+    const int searchGrainSize = std::max(parallelGrainSize / radius, 4 * radius);
+    std::vector<int> neighbors(count);
+    std::vector<int> nextClusters;
+    std::vector<AABB> nextBounds;
+    nextClusters.reserve(count);
+    nextBounds.reserve(count);
+    int nextNode = count - 2;
+
+    while (clusters.size() > 1) {
+        const int clusterCount = (int)clusters.size();
+
+        // Pairs are ordered by (area, lower index, higher index), candidates of every cluster are compared
+        // in ascending index order with a strict comparison, so the best pair overall is always mutual
+        // and every iteration merges something. A chunk evaluates each pair touching it once,
+        // for both clusters, which needs the radius before the chunk as well
+        threadPool->parallelFor(0, clusterCount, searchGrainSize, [&](int chunkBegin, int chunkEnd) {
+            const int windowBegin = std::max(0, chunkBegin - radius);
+            const int windowEnd = std::min(clusterCount, chunkEnd + radius);
+            std::vector<float> bestAreas(windowEnd - windowBegin, FLT_MAX);
+            std::vector<int> best(windowEnd - windowBegin, -1);
+
+            for (int i = windowBegin; i < chunkEnd; ++i) {
+                const AABB& bounds = clusterBounds[i];
+                const int searchEnd = std::min(windowEnd, i + radius + 1);
+                for (int j = std::max(i + 1, chunkBegin); j < searchEnd; ++j) {
+                    AABB merged = bounds;
+                    merged.surrounding(clusterBounds[j]);
+                    const float area = merged.surfaceArea();
+                    if (area < bestAreas[i - windowBegin]) {
+                        bestAreas[i - windowBegin] = area;
+                        best[i - windowBegin] = j;
+                    }
+                    if (area < bestAreas[j - windowBegin]) {
+                        bestAreas[j - windowBegin] = area;
+                        best[j - windowBegin] = i;
+                    }
+                }
+            }
+            std::copy(best.begin() + (chunkBegin - windowBegin), best.begin() + (chunkEnd - windowBegin), neighbors.begin() + chunkBegin);
+        });
+
+        // merged cluster takes the place of the lower one, the higher one is dropped,
+        // sequential, so node numbering does not depend on scheduling
+        nextClusters.clear();
+        nextBounds.clear();
+        for (int i = 0; i < clusterCount; ++i) {
+            const int neighbor = neighbors[i];
+            if (neighbors[neighbor] != i) {
+                nextClusters.push_back(clusters[i]);
+                nextBounds.push_back(clusterBounds[i]);
+            } else if (i < neighbor) {
+                Node& node = nodeList[nextNode];
+                node.leftChild = clusters[i];
+                node.rightChild = clusters[neighbor];
+                node.aabb = clusterBounds[i];
+                node.aabb.surrounding(clusterBounds[neighbor]);
+                nextClusters.push_back(nextNode--);
+                nextBounds.push_back(node.aabb);
+            }
+        }
+        clusters.swap(nextClusters);
+        clusterBounds.swap(nextBounds);
+    }
+
+    nodeCount = 2 * count - 1;
+}
+
+void BVHBuilder::collapseLeaves()
+{
+    const int totalNodes = (int)nodeList.size();
+    const int maxLeafSize = std::max(settings.maxLeafSize, 1);
+
+    // bottom-up SAH cost (not divided by root area) of the best choice for every subtree
+    std::vector<int> counts(totalNodes);
+    std::vector<float> costs(totalNodes);
+    std::vector<char> collapsed(totalNodes, 0);
+    for (int i = totalNodes - 1; i >= 0; --i) {
+        const Node& node = nodeList[i];
+        const float area = node.aabb.surfaceArea();
+        if (node.isLeaf()) {
+            counts[i] = node.triangleCount();
+            costs[i] = settings.intersectionCost * counts[i] * area;
+            continue;
+        }
+        counts[i] = counts[node.leftChild] + counts[node.rightChild];
+        const float splitCost = settings.traversalCost * area + costs[node.leftChild] + costs[node.rightChild];
+        const float leafCost = settings.intersectionCost * counts[i] * area;
+        collapsed[i] = counts[i] <= maxLeafSize && leafCost <= splitCost;
+        costs[i] = collapsed[i] ? leafCost : splitCost;
+    }
+
+    std::vector<Node> ordered;
+    ordered.reserve(totalNodes);
+    std::vector<int> orderedTriangles;
+    orderedTriangles.reserve(triangleIndices.size());
+
+    // same walk as reorderDepthFirst(), collapsed subtrees list the triangles of their leaves
+    std::vector<std::pair<int, int*>> stack;
+    std::vector<int> subtree;
+    stack.push_back({ 0, nullptr });
+    while (!stack.empty()) {
+        auto [oldIndex, parentSlot] = stack.back();
+        stack.pop_back();
+
+        if (parentSlot)
+            *parentSlot = (int)ordered.size();
+        ordered.push_back(nodeList[oldIndex]);
+        Node& node = ordered.back();
+
+        if (!node.isLeaf() && !collapsed[oldIndex]) {
+            stack.push_back({ node.rightChild, &node.rightChild });
+            stack.push_back({ node.leftChild, &node.leftChild });
+            continue;
+        }
+
+        const int offset = (int)orderedTriangles.size();
+        subtree.push_back(oldIndex);
+        while (!subtree.empty()) {
+            const Node& child = nodeList[subtree.back()];
+            subtree.pop_back();
+            if (child.isLeaf()) {
+                orderedTriangles.insert(orderedTriangles.end(),
+                    triangleIndices.begin() + child.triangleOffset(),
+                    triangleIndices.begin() + child.triangleOffset() + child.triangleCount());
+            } else {
+                subtree.push_back(child.rightChild);
+                subtree.push_back(child.leftChild);
+            }
+        }
+        node.setLeaf(offset, counts[oldIndex]);
+    }
+
+    nodeList = std::move(ordered);
+    nodeCount = (int)nodeList.size();
+    triangleIndices = std::move(orderedTriangles);
+}
+
+namespace {
+struct ObjectSplit {
+    float cost = FLT_MAX; // SA(L) * N(L) + SA(R) * N(R)
+    int axis = 0;
+    int bin = 0;
+    AABB leftBounds = AABB::empty();
+    AABB rightBounds = AABB::empty();
+};
+
+struct SpatialSplit {
+    float cost = FLT_MAX;
+    int axis = 0;
+    float position = 0.0f;
+    AABB leftBounds = AABB::empty();
+    AABB rightBounds = AABB::empty();
+    int leftCount = 0;
+    int rightCount = 0;
+};
+
+struct SpatialBin {
+    AABB aabb = AABB::empty();
+    int entries = 0; // references starting in this bin
+    int exits = 0; // references ending in this bin
+};
+
+vec3 referenceCenter(TriangleReference const& ref)
+{
+    return (ref.aabb.getMin() + ref.aabb.getMax()) * 0.5f;
+}
+
+int objectBin(TriangleReference const& ref, int axis, AABB const& centroidBounds, int binCount)
+{
+    const float extent = centroidBounds.getMax()[axis] - centroidBounds.getMin()[axis];
+    const float offset = referenceCenter(ref)[axis] - centroidBounds.getMin()[axis];
+    return glm::clamp(int(offset * binCount / extent), 0, binCount - 1);
+}
+
+ObjectSplit findObjectSplit(std::vector<TriangleReference> const& refs, AABB const& centroidBounds, int binCount)
+{
+    ObjectSplit best;
+    std::vector<Bin> bins(binCount);
+    std::vector<AABB> rightBounds(binCount);
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (centroidBounds.getMax()[axis] <= centroidBounds.getMin()[axis])
+            continue;
+
+        std::fill(bins.begin(), bins.end(), Bin());
+        for (TriangleReference const& ref : refs) {
+            Bin& bin = bins[objectBin(ref, axis, centroidBounds, binCount)];
+            bin.aabb.surrounding(ref.aabb);
+            bin.count++;
+        }
+
+        AABB accum = AABB::empty();
+        for (int i = binCount - 1; i > 0; --i) {
+            accum.surrounding(bins[i].aabb);
+            rightBounds[i - 1] = accum;
+        }
+
+        accum = AABB::empty();
+        int leftCount = 0;
+        for (int i = 0; i < binCount - 1; ++i) {
+            accum.surrounding(bins[i].aabb);
+            leftCount += bins[i].count;
+            const int rightCount = (int)refs.size() - leftCount;
+            if (leftCount == 0 || rightCount == 0)
+                continue;
+
+            float cost = accum.surfaceArea() * leftCount + rightBounds[i].surfaceArea() * rightCount;
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.bin = i;
+                best.leftBounds = accum;
+                best.rightBounds = rightBounds[i];
+            }
+        }
+    }
+    return best;
+}
+
+// Split reference by plane axis = position: clip triangle edges against the plane
+// and bound the parts, result is limited by the reference box (it may be clipped already)
+void splitReference(const Model3D& model, TriangleReference const& ref, int axis, float position,
+    TriangleReference& left, TriangleReference& right)
+{
+    const glm::ivec3& t = model.triangles[ref.triangle];
+    const vec3 v[3] = { model.vertices[t.x].position, model.vertices[t.y].position, model.vertices[t.z].position };
+
+    AABB leftBox = AABB::empty();
+    AABB rightBox = AABB::empty();
+    for (int i = 0; i < 3; ++i) {
+        const vec3& v0 = v[i];
+        const vec3& v1 = v[(i + 1) % 3];
+
+        if (v0[axis] <= position)
+            leftBox.surrounding(v0);
+        if (v0[axis] >= position)
+            rightBox.surrounding(v0);
+
+        if ((v0[axis] < position && v1[axis] > position) || (v0[axis] > position && v1[axis] < position)) {
+            float t = glm::clamp((position - v0[axis]) / (v1[axis] - v0[axis]), 0.0f, 1.0f);
+            vec3 p = v0 + (v1 - v0) * t;
+            leftBox.surrounding(p);
+            rightBox.surrounding(p);
+        }
+    }
+
+    vec3 planeMax(FLT_MAX), planeMin(-FLT_MAX);
+    planeMax[axis] = position;
+    planeMin[axis] = position;
+    leftBox.clip(AABB(vec3(-FLT_MAX), planeMax));
+    rightBox.clip(AABB(planeMin, vec3(FLT_MAX)));
+    leftBox.clip(ref.aabb);
+    rightBox.clip(ref.aabb);
+
+    left = { ref.triangle, leftBox };
+    right = { ref.triangle, rightBox };
+}
+
+SpatialSplit findSpatialSplit(const Model3D& model, std::vector<TriangleReference> const& refs, AABB const& nodeBounds, int binCount)
+{
+    SpatialSplit best;
+    std::vector<SpatialBin> bins(binCount);
+    std::vector<AABB> rightBounds(binCount);
+    std::vector<int> rightCounts(binCount);
+
+    for (int axis = 0; axis < 3; ++axis) {
+        const float origin = nodeBounds.getMin()[axis];
+        const float binWidth = (nodeBounds.getMax()[axis] - origin) / binCount;
+        if (binWidth <= 0.0f)
+            continue;
+
+        auto binOf = [&](float position) { return glm::clamp(int((position - origin) / binWidth), 0, binCount - 1); };
+
+        // chop every reference by the bin planes it crosses
+        std::fill(bins.begin(), bins.end(), SpatialBin());
+        for (TriangleReference const& ref : refs) {
+            const int firstBin = binOf(ref.aabb.getMin()[axis]);
+            const int lastBin = binOf(ref.aabb.getMax()[axis]);
+
+            TriangleReference rest = ref;
+            for (int b = firstBin; b < lastBin; ++b) {
+                TriangleReference left, right;
+                splitReference(model, rest, axis, origin + binWidth * (b + 1), left, right);
+                bins[b].aabb.surrounding(left.aabb);
+                rest = right;
+            }
+            bins[lastBin].aabb.surrounding(rest.aabb);
+            bins[firstBin].entries++;
+            bins[lastBin].exits++;
+        }
+
+        AABB accum = AABB::empty();
+        int count = 0;
+        for (int i = binCount - 1; i > 0; --i) {
+            accum.surrounding(bins[i].aabb);
+            count += bins[i].exits;
+            rightBounds[i - 1] = accum;
+            rightCounts[i - 1] = count;
+        }
+
+        accum = AABB::empty();
+        count = 0;
+        for (int i = 0; i < binCount - 1; ++i) {
+            accum.surrounding(bins[i].aabb);
+            count += bins[i].entries;
+            if (count == 0 || rightCounts[i] == 0)
+                continue;
+
+            float cost = accum.surfaceArea() * count + rightBounds[i].surfaceArea() * rightCounts[i];
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.position = origin + binWidth * (i + 1);
+                best.leftBounds = accum;
+                best.rightBounds = rightBounds[i];
+                best.leftCount = count;
+                best.rightCount = rightCounts[i];
+            }
+        }
+    }
+    return best;
+}
+}
+
+void BVHBuilder::buildSpatialRecursive(int nodeIndex, std::vector<TriangleReference>& refs, int depth)
+{
+    // spatial splits stop shrinking nodes at some depth, float precision ends there
+    constexpr int maxSpatialDepth = 64;
+
+    const int count = (int)refs.size();
+    const int binCount = std::max(settings.sahBinCount, 2);
+
+    Node& node = nodeList[nodeIndex];
+    node.aabb = AABB::empty();
+    AABB centroidBounds = AABB::empty();
+    for (TriangleReference const& ref : refs) {
+        node.aabb.surrounding(ref.aabb);
+        centroidBounds.surrounding(referenceCenter(ref));
+    }
+
+    auto makeLeaf = [&]() {
+        const int offset = leafReferenceCount.fetch_add(count);
+        assert(offset + count <= (int)triangleIndices.size() && "Spatial splits exceeded the reference budget");
+        for (int i = 0; i < count; ++i)
+            triangleIndices[offset + i] = refs[i].triangle;
+        node.setLeaf(offset, count);
+        std::vector<TriangleReference>().swap(refs);
     };
 
-    using namespace std::placeholders;
+    if (count == 1) {
+        makeLeaf();
+        return;
+    }
 
-    if (axis == 0)
-        splitByAxis(bind(&vec3::x, _1));
+    const ObjectSplit objectSplit = findObjectSplit(refs, centroidBounds, binCount);
 
-    if (axis == 1)
-        splitByAxis(bind(&vec3::y, _1));
+    // spatial split only where object split children overlap noticeably
+    SpatialSplit spatialSplit;
+    if (depth < maxSpatialDepth && referenceCount < maxReferenceCount) {
+        AABB overlap = objectSplit.leftBounds;
+        overlap.clip(objectSplit.rightBounds);
+        if (objectSplit.cost == FLT_MAX || overlap.surfaceArea() > settings.spatialSplitAlpha * spatialRootArea)
+            spatialSplit = findSpatialSplit(*spatialModel, refs, node.aabb, binCount);
+    }
 
-    if (axis == 2)
-        splitByAxis(bind(&vec3::z, _1));
+    const float bestCost = std::min(objectSplit.cost, spatialSplit.cost);
+    const float parentArea = node.aabb.surfaceArea();
+    if (count <= std::max(settings.maxLeafSize, 1)) {
+        const bool leafIsCheaper = bestCost == FLT_MAX || parentArea <= 0.0f
+            || settings.intersectionCost * count <= settings.traversalCost + settings.intersectionCost * bestCost / parentArea;
+        if (leafIsCheaper) {
+            makeLeaf();
+            return;
+        }
+    }
 
-    const auto& tl0 = tempLeftTriangleList[0];
-    const auto& tr0 = tempRightTriangleList[0];
-    if (tempLeftTriangleList.size() == 1) {
-        node.leftChild = -tl0.getIndex();
+    std::vector<TriangleReference> leftRefs, rightRefs;
 
-    } else {
-        node.leftChild = (int)nodeList.size();
-        nodeList.emplace_back();
-        buildRecurcive(nodeList.size() - 1, tempLeftTriangleList);
+    bool useSpatial = spatialSplit.cost < objectSplit.cost;
+    int reserved = 0;
+    if (useSpatial) {
+        // reserve duplicates before splitting, unsplitting may return some of them
+        reserved = spatialSplit.leftCount + spatialSplit.rightCount - count;
+        if (referenceCount.fetch_add(reserved) + reserved > maxReferenceCount) {
+            referenceCount -= reserved;
+            useSpatial = false;
+        }
     }
 
-    if (tempRightTriangleList.size() == 1) {
-        node.rightChild = -tr0.getIndex();
+    if (useSpatial) {
+        const int axis = spatialSplit.axis;
+        const float position = spatialSplit.position;
+        AABB leftBounds = spatialSplit.leftBounds;
+        AABB rightBounds = spatialSplit.rightBounds;
+        int leftCount = spatialSplit.leftCount;
+        int rightCount = spatialSplit.rightCount;
 
+        for (TriangleReference const& ref : refs) {
+            if (ref.aabb.getMax()[axis] <= position) {
+                leftRefs.push_back(ref);
+            } else if (ref.aabb.getMin()[axis] >= position) {
+                rightRefs.push_back(ref);
+            } else {
+                // straddling reference: duplicate, or move it whole to one side if that is cheaper
+                TriangleReference left, right;
+                splitReference(*spatialModel, ref, axis, position, left, right);
+
+                AABB leftWithRef = leftBounds, rightWithRef = rightBounds;
+                leftWithRef.surrounding(ref.aabb);
+                rightWithRef.surrounding(ref.aabb);
+
+                const float splitCost = leftBounds.surfaceArea() * leftCount + rightBounds.surfaceArea() * rightCount;
+                const float toLeftCost = leftWithRef.surfaceArea() * leftCount + rightBounds.surfaceArea() * (rightCount - 1);
+                const float toRightCost = leftBounds.surfaceArea() * (leftCount - 1) + rightWithRef.surfaceArea() * rightCount;
+
+                // a clipped part can be empty when the triangle only touches the plane
+                const bool canSplit = left.aabb.isValid() && right.aabb.isValid();
+                if (canSplit && splitCost <= toLeftCost && splitCost <= toRightCost) {
+                    leftRefs.push_back(left);
+                    rightRefs.push_back(right);
+                } else if (toLeftCost <= toRightCost || !right.aabb.isValid()) {
+                    leftRefs.push_back(ref);
+                    leftBounds = leftWithRef;
+                    rightCount--;
+                } else {
+                    rightRefs.push_back(ref);
+                    rightBounds = rightWithRef;
+                    leftCount--;
+                }
+            }
+        }
+
+        // Binned counts and the position compares above may disagree on references touching the plane,
+        // so the actual duplicates must fit the budget too, referenceCount then includes them
+        const int duplicates = (int)leftRefs.size() + (int)rightRefs.size() - count;
+        bool fitsBudget = true;
+        if (duplicates > reserved)
+            fitsBudget = referenceCount.fetch_add(duplicates - reserved) + duplicates - reserved <= maxReferenceCount;
+        else
+            referenceCount -= reserved - duplicates;
+
+        // over budget, or unsplitting moved everything to one side
+        if (!fitsBudget || leftRefs.empty() || rightRefs.empty()) {
+            referenceCount -= duplicates;
+            leftRefs.clear();
+            rightRefs.clear();
+            useSpatial = false;
+        }
+    }
+
+    if (!useSpatial) {
+        if (objectSplit.cost < FLT_MAX) {
+            for (TriangleReference const& ref : refs) {
+                if (objectBin(ref, objectSplit.axis, centroidBounds, binCount) <= objectSplit.bin)
+                    leftRefs.push_back(ref);
+                else
+                    rightRefs.push_back(ref);
+            }
+        } else {
+            // all centers are equal
+            leftRefs.assign(refs.begin(), refs.begin() + count / 2);
+            rightRefs.assign(refs.begin() + count / 2, refs.end());
+        }
+    }
+
+    std::vector<TriangleReference>().swap(refs);
+
+    ThreadPool::TaskGroup group(*threadPool);
+
+    const int leftIndex = nodeCount++;
+    const int rightIndex = nodeCount++;
+    node.leftChild = leftIndex;
+    node.rightChild = rightIndex;
+
+    // subtrees share the duplication budget, who takes it first depends on scheduling,
+    // so deterministic build is sequential here
+    if (count >= taskSpawnSize && !settings.deterministic)
+        group.run([this, leftIndex, &leftRefs, depth] { buildSpatialRecursive(leftIndex, leftRefs, depth + 1); });
+    else
+        buildSpatialRecursive(leftIndex, leftRefs, depth + 1);
+
+    buildSpatialRecursive(rightIndex, rightRefs, depth + 1);
+    group.wait();
+}
+
+float BVHBuilder::getDuplicationFactor() const
+{
+    if (modelTriangleCount == 0)
+        return 1.0f;
+    return float(triangleIndices.size()) / modelTriangleCount;
+}
+
+DirtyRange BVHBuilder::refit(const Model3D& model)
+{
+    DirtyRange dirtyNodes;
+    if (!nodeList.empty())
+        refitRecursive(model, 0, 0, dirtyNodes);
+    return dirtyNodes;
+}
+
+AABB BVHBuilder::refitRecursive(const Model3D& model, int nodeIndex, int depth, DirtyRange& dirtyNodes)
+{
+    auto triangleBox = [&model](int triangle) {
+        const glm::ivec3& t = model.triangles[triangle];
+        const vec3& p0 = model.vertices[t.x].position;
+        const vec3& p1 = model.vertices[t.y].position;
+        const vec3& p2 = model.vertices[t.z].position;
+        return AABB(glm::min(glm::min(p0, p1), p2), glm::max(glm::max(p0, p1), p2));
+    };
+
+    Node& node = nodeList[nodeIndex];
+    AABB bounds = AABB::empty();
+
+    if (node.isLeaf()) {
+        for (int i = node.triangleOffset(); i < node.triangleOffset() + node.triangleCount(); ++i)
+            bounds.surrounding(triangleBox(triangleIndices[i]));
     } else {
-        node.rightChild = (int)nodeList.size();
-        nodeList.emplace_back();
-        buildRecurcive(nodeList.size() - 1, tempRightTriangleList);
+        AABB leftBounds;
+        DirtyRange leftDirty;
+        ThreadPool::TaskGroup group(*threadPool);
+
+        if (depth < refitTaskDepth)
+            group.run([&, depth] { leftBounds = refitRecursive(model, node.leftChild, depth + 1, leftDirty); });
+        else
+            leftBounds = refitRecursive(model, node.leftChild, depth + 1, dirtyNodes);
+
+        AABB rightBounds = refitRecursive(model, node.rightChild, depth + 1, dirtyNodes);
+
+        group.wait();
+        dirtyNodes.include(leftDirty);
+
+        bounds = leftBounds;
+        bounds.surrounding(rightBounds);
+    }
+
+    if (bounds.getMin() != node.aabb.getMin() || bounds.getMax() != node.aabb.getMax()) {
+        node.aabb = bounds;
+        dirtyNodes.include(nodeIndex);
+    }
+    return bounds;
+}
+
+void BVHBuilder::reorderDepthFirst()
+{
+    std::vector<Node> ordered;
+    ordered.reserve(nodeList.size());
+
+    // pairs of <old index, parent slot to patch in ordered list>
+    std::vector<std::pair<int, int*>> stack;
+    stack.push_back({ 0, nullptr });
+    while (!stack.empty()) {
+        auto [oldIndex, parentSlot] = stack.back();
+        stack.pop_back();
+
+        const int newIndex = (int)ordered.size();
+        if (parentSlot)
+            *parentSlot = newIndex;
+        ordered.push_back(nodeList[oldIndex]);
+
+        // ordered does not reallocate (reserved), so pointers to children fields stay valid
+        Node& node = ordered.back();
+        if (!node.isLeaf()) {
+            stack.push_back({ node.rightChild, &node.rightChild });
+            stack.push_back({ node.leftChild, &node.leftChild });
+        }
+    }
+
+    nodeList = std::move(ordered);
+
+    // leaves in preorder get consecutive triangle ranges
+    std::vector<int> orderedTriangles;
+    orderedTriangles.reserve(triangleIndices.size());
+    for (Node& node : nodeList) {
+        if (!node.isLeaf())
+            continue;
+        const int offset = (int)orderedTriangles.size();
+        orderedTriangles.insert(orderedTriangles.end(),
+            triangleIndices.begin() + node.triangleOffset(),
+            triangleIndices.begin() + node.triangleOffset() + node.triangleCount());
+        node.setLeaf(offset, node.triangleCount());
+    }
+    triangleIndices = std::move(orderedTriangles);
+}
+
+float BVHBuilder::computeSAHCost() const
+{
+    if (nodeList.empty())
+        return 0.0f;
+
+    const float rootArea = nodeList[0].aabb.surfaceArea();
+    if (rootArea <= 0.0f)
+        return 0.0f;
+
+    float cost = 0.0f;
+    for (Node const& node : nodeList) {
+        float nodeCost = node.isLeaf()
+            ? settings.intersectionCost * node.triangleCount()
+            : settings.traversalCost;
+        cost += nodeCost * node.aabb.surfaceArea();
     }
+    return cost / rootArea;
 }
@@ -0,0 +1,249 @@
+#include "BVHCache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+namespace {
+constexpr char magic[8] = { 'B', 'V', 'H', 'C', 'A', 'C', 'H', 'E' };
+constexpr uint32_t version = 2; // bump on any change of the file layout or of the packed formats
+constexpr uint64_t sectionAlignment = 64;
+
+static_assert(std::is_trivially_copyable<Vertex>::value, "Vertex is stored as raw bytes");
+static_assert(std::is_trivially_copyable<Node>::value, "Node is stored as raw bytes");
+
+// FNV-1a over 64 bit words with a final avalanche, fast enough to hash large scans on every launch
+class Hasher {
+public:
+    void add(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            mix(word);
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, bytes + i, size - i);
+        mix(tail ^ uint64_t(size) << 56);
+    }
+
+    template <typename T>
+    void add(T const& value)
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Only plain values");
+        add(&value, sizeof(value));
+    }
+
+    uint64_t finish() const
+    {
+        uint64_t h = hash;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+private:
+    void mix(uint64_t word) { hash = (hash ^ word) * 0x100000001b3ull; }
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+};
+
+uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+// count elements at offset end inside the file, without overflow for any header values
+bool sectionFits(uint64_t fileSize, uint64_t offset, uint64_t count, uint64_t elementSize)
+{
+    return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+}
+}
+
+struct BVHCache::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t vertexSize;
+    uint32_t nodeSize;
+    Key key;
+    uint64_t fileSize;
+
+    uint64_t vertexCount, vertexOffset;
+    uint64_t triangleCount, triangleOffset;
+    uint64_t nodeCount, nodeOffset;
+    uint64_t triangleIndexCount, triangleIndexOffset;
+    uint64_t shaderDefinesSize, shaderDefinesOffset;
+    uint64_t texturePixelOffset;
+    GeometryTexture::Layout textureLayout;
+};
+
+bool BVHCache::makeKey(std::string const& sourcePath, BVHBuildSettings const& settings, uint32_t variant, Key& key)
+{
+    MappedFile source(sourcePath);
+    if (!source.isOpen())
+        return false;
+
+    Hasher sourceHasher;
+    sourceHasher.add(source.getData(), source.getSize());
+    key.sourceHash = sourceHasher.finish();
+
+    // Everything that changes the tree or its node numbering. Thread count is left out, without
+    // deterministic it only picks one of the scheduling orders, any of them is a valid cache
+    Hasher settingsHasher;
+    settingsHasher.add(settings.splitMethod);
+    settingsHasher.add(settings.sahBinCount);
+    settingsHasher.add(settings.traversalCost);
+    settingsHasher.add(settings.intersectionCost);
+    settingsHasher.add(settings.mortonBits);
+    settingsHasher.add(settings.maxLeafSize);
+    settingsHasher.add(settings.spatialSplitBudget);
+    settingsHasher.add(settings.spatialSplitAlpha);
+    settingsHasher.add(settings.plocRadius);
+    settingsHasher.add(settings.deterministic);
+    settingsHasher.add(variant);
+    key.settingsHash = settingsHasher.finish();
+    return true;
+}
+
+bool BVHCache::save(std::string const& cachePath, Key const& key, const Model3D& model, const BVHBuilder& bvh, const GeometryTexture& texture)
+{
+    const std::string& shaderDefines = texture.getShaderDefines();
+    const std::vector<float>& pixels = texture.getPixels();
+    if (pixels.empty())
+        return false;
+
+    Header header {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.headerSize = sizeof(Header);
+    header.vertexSize = sizeof(Vertex);
+    header.nodeSize = sizeof(Node);
+    header.key = key;
+
+    uint64_t offset = alignOffset(sizeof(Header));
+    auto place = [&offset](uint64_t& sectionOffset, uint64_t bytes) {
+        sectionOffset = offset;
+        offset = alignOffset(offset + bytes);
+    };
+
+    header.vertexCount = model.vertices.size();
+    place(header.vertexOffset, header.vertexCount * sizeof(Vertex));
+    header.triangleCount = model.triangles.size();
+    place(header.triangleOffset, header.triangleCount * sizeof(glm::ivec3));
+    header.nodeCount = bvh.getNodes().size();
+    place(header.nodeOffset, header.nodeCount * sizeof(Node));
+    header.triangleIndexCount = bvh.getTriangleIndices().size();
+    place(header.triangleIndexOffset, header.triangleIndexCount * sizeof(int));
+    header.shaderDefinesSize = shaderDefines.size();
+    place(header.shaderDefinesOffset, header.shaderDefinesSize);
+    header.textureLayout = texture.getLayout();
+    place(header.texturePixelOffset, pixels.size() * sizeof(float));
+    header.fileSize = offset;
+
+    const std::string temporaryPath = cachePath + ".tmp";
+    {
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!stream.is_open())
+            return false;
+
+        auto write = [&stream](uint64_t sectionOffset, const void* data, uint64_t bytes) {
+            static const char zeros[sectionAlignment] = {};
+            const uint64_t position = stream.tellp();
+            stream.write(zeros, sectionOffset - position);
+            stream.write(static_cast<const char*>(data), bytes);
+        };
+
+        write(0, &header, sizeof(Header));
+        write(header.vertexOffset, model.vertices.data(), header.vertexCount * sizeof(Vertex));
+        write(header.triangleOffset, model.triangles.data(), header.triangleCount * sizeof(glm::ivec3));
+        write(header.nodeOffset, bvh.getNodes().data(), header.nodeCount * sizeof(Node));
+        write(header.triangleIndexOffset, bvh.getTriangleIndices().data(), header.triangleIndexCount * sizeof(int));
+        write(header.shaderDefinesOffset, shaderDefines.data(), header.shaderDefinesSize);
+        write(header.texturePixelOffset, pixels.data(), pixels.size() * sizeof(float));
+        if (!stream.good())
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, cachePath, error);
+    return !error;
+}
+
+bool BVHCache::open(std::string const& cachePath, Key const& key)
+{
+    file = MappedFile(cachePath);
+    if (!file.isOpen() || file.getSize() < sizeof(Header))
+        return false;
+
+    const Header& h = header();
+    const bool isValid = std::memcmp(h.magic, magic, sizeof(magic)) == 0
+        && h.version == version
+        && h.headerSize == sizeof(Header)
+        && h.vertexSize == sizeof(Vertex)
+        && h.nodeSize == sizeof(Node)
+        && h.key.sourceHash == key.sourceHash
+        && h.key.settingsHash == key.settingsHash
+        && h.fileSize == file.getSize();
+
+    // a truncated or corrupt file must not point past the mapping
+    const GeometryTexture::Layout& layout = h.textureLayout;
+    const uint64_t size = file.getSize();
+    const bool sectionsFit = isValid
+        && sectionFits(size, h.vertexOffset, h.vertexCount, sizeof(Vertex))
+        && sectionFits(size, h.triangleOffset, h.triangleCount, sizeof(glm::ivec3))
+        && sectionFits(size, h.nodeOffset, h.nodeCount, sizeof(Node))
+        && sectionFits(size, h.triangleIndexOffset, h.triangleIndexCount, sizeof(int))
+        && sectionFits(size, h.shaderDefinesOffset, h.shaderDefinesSize, 1)
+        && layout.width > 0 && layout.height > 0 // RGBA32F pixels
+        && sectionFits(size, h.texturePixelOffset, uint64_t(layout.width) * uint64_t(layout.height) * 4, sizeof(float));
+
+    if (!sectionsFit)
+        file.close();
+    return sectionsFit;
+}
+
+const BVHCache::Header& BVHCache::header() const
+{
+    return *section<Header>(0);
+}
+
+void BVHCache::loadModel(Model3D& model) const
+{
+    const Header& h = header();
+    const Vertex* vertices = section<Vertex>(h.vertexOffset);
+    const glm::ivec3* triangles = section<glm::ivec3>(h.triangleOffset);
+    model.vertices.assign(vertices, vertices + h.vertexCount);
+    model.triangles.assign(triangles, triangles + h.triangleCount);
+}
+
+void BVHCache::loadBVH(BVHBuilder& bvh) const
+{
+    const Header& h = header();
+    const Node* nodes = section<Node>(h.nodeOffset);
+    const int* triangleIndices = section<int>(h.triangleIndexOffset);
+
+    bvh.nodeList.assign(nodes, nodes + h.nodeCount);
+    bvh.nodeCount = h.nodeCount;
+    bvh.triangleIndices.assign(triangleIndices, triangleIndices + h.triangleIndexCount);
+    bvh.modelTriangleCount = h.triangleCount;
+}
+
+GeometryTexture::Layout BVHCache::getTextureLayout() const
+{
+    return header().textureLayout;
+}
+
+const float* BVHCache::getTexturePixels() const
+{
+    return section<float>(header().texturePixelOffset);
+}
+
+std::string BVHCache::getShaderDefines() const
+{
+    const Header& h = header();
+    return std::string(section<char>(h.shaderDefinesOffset), h.shaderDefinesSize);
+}
@@ -0,0 +1,499 @@
+#include "BVHEditor.h"
+#include <algorithm>
+#include <cassert>
+#include <queue>
+
+namespace {
+AABB unite(AABB a, AABB const& b)
+{
+    a.surrounding(b);
+    return a;
+}
+
+// <inherited cost, node>, the lowest inherited cost first
+using Candidate = std::pair<float, int>;
+}
+
+BVHEditor::BVHEditor(BVHBuilder& bvh, std::vector<AABB> primitiveBounds, BVHEditSettings const& settings)
+    : bvh(bvh)
+    , settings(settings)
+    , primitiveBounds(std::move(primitiveBounds))
+{
+    attach();
+}
+
+std::vector<AABB> BVHEditor::triangleBounds(const Model3D& model, int first, int count)
+{
+    std::vector<AABB> bounds(count);
+    for (int i = 0; i < count; ++i) {
+        const glm::ivec3& t = model.triangles[first + i];
+        const glm::vec3& p0 = model.vertices[t.x].position;
+        const glm::vec3& p1 = model.vertices[t.y].position;
+        const glm::vec3& p2 = model.vertices[t.z].position;
+        bounds[i] = AABB(glm::min(glm::min(p0, p1), p2), glm::max(glm::max(p0, p1), p2));
+    }
+    return bounds;
+}
+
+void BVHEditor::attach()
+{
+    std::vector<Node>& nodes = bvh.nodeList;
+    std::vector<int>& triangleIndices = bvh.triangleIndices;
+
+    parents.assign(nodes.size(), -1);
+    primitiveLeaf.assign(primitiveBounds.size(), -1);
+    primitiveSlot.assign(primitiveBounds.size(), -1);
+    freeNodes.clear();
+    freeSlots.clear();
+
+    std::vector<bool> reachedNodes(nodes.size(), false);
+    std::vector<bool> usedSlots(triangleIndices.size(), false);
+    std::vector<int> stack;
+    if (!nodes.empty())
+        stack.push_back(0);
+
+    while (!stack.empty()) {
+        const int nodeIndex = stack.back();
+        stack.pop_back();
+        reachedNodes[nodeIndex] = true;
+
+        const Node& node = nodes[nodeIndex];
+        if (node.isLeaf()) {
+            for (int slot = node.triangleOffset(); slot < node.triangleOffset() + node.triangleCount(); ++slot) {
+                const int primitive = triangleIndices[slot];
+                assert(primitive < (int)primitiveBounds.size() && "No bounds for a primitive of the tree");
+                assert(primitiveLeaf[primitive] < 0 && "Every primitive must be referenced once, spatial splits are not supported");
+                primitiveLeaf[primitive] = nodeIndex;
+                primitiveSlot[primitive] = slot;
+                usedSlots[slot] = true;
+            }
+            continue;
+        }
+
+        parents[node.leftChild] = nodeIndex;
+        parents[node.rightChild] = nodeIndex;
+        stack.push_back(node.rightChild);
+        stack.push_back(node.leftChild);
+    }
+
+    for (int i = (int)nodes.size() - 1; i > 0; --i)
+        if (!reachedNodes[i])
+            freeNode(i);
+    for (int i = (int)triangleIndices.size() - 1; i >= 0; --i)
+        if (!usedSlots[i])
+            freeSlots.push_back(i);
+
+    builtCost = bvh.computeSAHCost();
+}
+
+bool BVHEditor::contains(int primitive) const
+{
+    return primitive < (int)primitiveLeaf.size() && primitiveLeaf[primitive] >= 0;
+}
+
+int BVHEditor::allocateNode()
+{
+    if (!freeNodes.empty()) {
+        const int nodeIndex = freeNodes.back();
+        freeNodes.pop_back();
+        return nodeIndex;
+    }
+    bvh.nodeList.emplace_back();
+    parents.push_back(-1);
+    return bvh.nodeList.size() - 1;
+}
+
+int BVHEditor::allocateSlot()
+{
+    if (!freeSlots.empty()) {
+        const int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    bvh.triangleIndices.push_back(-1);
+    return bvh.triangleIndices.size() - 1;
+}
+
+int BVHEditor::allocateSlots(int count)
+{
+    if (count == 1)
+        return allocateSlot();
+
+    std::sort(freeSlots.begin(), freeSlots.end());
+    int runBegin = 0;
+    for (int i = 0; i < (int)freeSlots.size(); ++i) {
+        if (i > runBegin && freeSlots[i] != freeSlots[i - 1] + 1)
+            runBegin = i;
+        if (i - runBegin + 1 == count) {
+            const int offset = freeSlots[runBegin];
+            freeSlots.erase(freeSlots.begin() + runBegin, freeSlots.begin() + i + 1);
+            return offset;
+        }
+    }
+
+    const int offset = bvh.triangleIndices.size();
+    bvh.triangleIndices.resize(offset + count, -1);
+    return offset;
+}
+
+void BVHEditor::freeNode(int nodeIndex)
+{
+    // unreachable, an empty box adds nothing to computeSAHCost()
+    Node& node = bvh.nodeList[nodeIndex];
+    node = Node();
+    node.aabb = AABB::empty();
+    parents[nodeIndex] = -1;
+    freeNodes.push_back(nodeIndex);
+}
+
+void BVHEditor::setNode(int nodeIndex, Node const& node)
+{
+    bvh.nodeList[nodeIndex] = node;
+    dirtyNodes.push_back(nodeIndex);
+
+    if (node.isLeaf()) {
+        for (int slot = node.triangleOffset(); slot < node.triangleOffset() + node.triangleCount(); ++slot) {
+            primitiveLeaf[bvh.triangleIndices[slot]] = nodeIndex;
+            primitiveSlot[bvh.triangleIndices[slot]] = slot;
+        }
+    } else {
+        parents[node.leftChild] = nodeIndex;
+        parents[node.rightChild] = nodeIndex;
+    }
+}
+
+void BVHEditor::insert(int primitive, AABB const& bounds)
+{
+    if (primitive >= (int)primitiveBounds.size()) {
+        primitiveBounds.resize(primitive + 1);
+        primitiveLeaf.resize(primitive + 1, -1);
+        primitiveSlot.resize(primitive + 1, -1);
+    }
+    assert(!contains(primitive) && "Primitive is already in the tree");
+    primitiveBounds[primitive] = bounds;
+
+    const int slot = allocateSlot();
+    bvh.triangleIndices[slot] = primitive;
+    dirtySlots.push_back(slot);
+
+    const bool wasEmpty = bvh.nodeList.empty();
+    const int leaf = allocateNode();
+    Node node;
+    node.aabb = bounds;
+    node.setLeaf(slot, 1);
+    setNode(leaf, node);
+
+    if (!wasEmpty)
+        insertNode(leaf);
+}
+
+void BVHEditor::insertSubtree(const BVHBuilder& subtree, std::vector<AABB> const& bounds, int primitiveOffset)
+{
+    const std::vector<Node>& subtreeNodes = subtree.getNodes();
+    const std::vector<int>& subtreeIndices = subtree.getTriangleIndices();
+    if (subtreeNodes.empty())
+        return;
+    assert(subtreeIndices.size() == bounds.size() && "Every primitive of the subtree must be referenced once");
+
+    const int primitiveEnd = primitiveOffset + bounds.size();
+    if (primitiveEnd > (int)primitiveBounds.size()) {
+        primitiveBounds.resize(primitiveEnd);
+        primitiveLeaf.resize(primitiveEnd, -1);
+        primitiveSlot.resize(primitiveEnd, -1);
+    }
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        assert(!contains(primitiveOffset + i) && "Primitive is already in the tree");
+        primitiveBounds[primitiveOffset + i] = bounds[i];
+    }
+
+    // the subtree root is allocated first, so it becomes the root of an empty tree
+    const bool wasEmpty = bvh.nodeList.empty();
+    std::vector<int> nodeIndices(subtreeNodes.size());
+    for (int& nodeIndex : nodeIndices)
+        nodeIndex = allocateNode();
+
+    for (size_t i = 0; i < subtreeNodes.size(); ++i) {
+        Node node = subtreeNodes[i];
+        if (node.isLeaf()) {
+            // bigger leaves need a contiguous run of free slots or one at the end
+            const int count = node.triangleCount();
+            const int offset = allocateSlots(count);
+
+            for (int k = 0; k < count; ++k) {
+                bvh.triangleIndices[offset + k] = primitiveOffset + subtreeIndices[node.triangleOffset() + k];
+                dirtySlots.push_back(offset + k);
+            }
+            node.setLeaf(offset, count);
+        } else {
+            node.leftChild = nodeIndices[node.leftChild];
+            node.rightChild = nodeIndices[node.rightChild];
+        }
+        setNode(nodeIndices[i], node);
+    }
+
+    if (!wasEmpty)
+        insertNode(nodeIndices[0]);
+}
+
+void BVHEditor::remove(int primitive)
+{
+    assert(contains(primitive) && "Primitive is not in the tree");
+    std::vector<int>& triangleIndices = bvh.triangleIndices;
+    const int leaf = primitiveLeaf[primitive];
+    const int slot = primitiveSlot[primitive];
+    primitiveLeaf[primitive] = -1;
+    primitiveSlot[primitive] = -1;
+
+    Node node = bvh.nodeList[leaf];
+    if (node.triangleCount() > 1) {
+        // the last primitive of the leaf takes the slot, the leaf range shrinks from its end
+        const int last = node.triangleOffset() + node.triangleCount() - 1;
+        if (slot != last) {
+            triangleIndices[slot] = triangleIndices[last];
+            dirtySlots.push_back(slot);
+        }
+        freeSlots.push_back(last);
+        node.setLeaf(node.triangleOffset(), node.triangleCount() - 1);
+        setNode(leaf, node);
+        refitUpwards(leaf);
+        return;
+    }
+    freeSlots.push_back(slot);
+
+    if (leaf == 0) {
+        // the last primitive, every slot is free now
+        bvh.nodeList.clear();
+        bvh.triangleIndices.clear();
+        parents.clear();
+        freeNodes.clear();
+        freeSlots.clear();
+        return;
+    }
+
+    // the sibling takes the place of the parent
+    const int parent = parents[leaf];
+    const Node& parentNode = bvh.nodeList[parent];
+    const int sibling = parentNode.leftChild == leaf ? parentNode.rightChild : parentNode.leftChild;
+
+    if (parent == 0) {
+        const Node siblingNode = bvh.nodeList[sibling];
+        setNode(0, siblingNode);
+        freeNode(sibling);
+        freeNode(leaf);
+        return;
+    }
+
+    const int grandparent = parents[parent];
+    Node grandparentNode = bvh.nodeList[grandparent];
+    if (grandparentNode.leftChild == parent)
+        grandparentNode.leftChild = sibling;
+    else
+        grandparentNode.rightChild = sibling;
+    setNode(grandparent, grandparentNode);
+    freeNode(parent);
+    freeNode(leaf);
+    refitUpwards(grandparent);
+}
+
+int BVHEditor::findBestSibling(AABB const& bounds) const
+{
+    const std::vector<Node>& nodes = bvh.nodeList;
+    const float area = bounds.surfaceArea();
+
+    // Cost of pairing with a node: area of the new parent plus growth of all ancestors (inherited cost).
+    // A subtree can not do better than its inherited cost plus the area of the inserted box
+    int best = 0;
+    float bestCost = unite(nodes[0].aabb, bounds).surfaceArea();
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+    queue.push({ 0.0f, 0 });
+    while (!queue.empty()) {
+        const auto [inherited, nodeIndex] = queue.top();
+        queue.pop();
+        if (inherited + area >= bestCost)
+            break;
+
+        const Node& node = nodes[nodeIndex];
+        const float unionArea = unite(node.aabb, bounds).surfaceArea();
+        const float cost = unionArea + inherited;
+        if (cost < bestCost) {
+            best = nodeIndex;
+            bestCost = cost;
+        }
+
+        if (node.isLeaf())
+            continue;
+
+        const float childInherited = inherited + unionArea - node.aabb.surfaceArea();
+        if (childInherited + area < bestCost) {
+            queue.push({ childInherited, node.leftChild });
+            queue.push({ childInherited, node.rightChild });
+        }
+    }
+    return best;
+}
+
+void BVHEditor::insertNode(int nodeIndex)
+{
+    const AABB bounds = bvh.nodeList[nodeIndex].aabb;
+    const int sibling = findBestSibling(bounds);
+    const int parent = allocateNode();
+
+    Node parentNode;
+    parentNode.aabb = unite(bvh.nodeList[sibling].aabb, bounds);
+
+    if (sibling == 0) {
+        // the root keeps index 0, its old content moves to the new node
+        const Node oldRoot = bvh.nodeList[0];
+        setNode(parent, oldRoot);
+        parentNode.leftChild = parent;
+        parentNode.rightChild = nodeIndex;
+        setNode(0, parentNode);
+        refitUpwards(0);
+        return;
+    }
+
+    const int grandparent = parents[sibling];
+    parentNode.leftChild = sibling;
+    parentNode.rightChild = nodeIndex;
+    setNode(parent, parentNode);
+    parents[parent] = grandparent;
+
+    Node grandparentNode = bvh.nodeList[grandparent];
+    if (grandparentNode.leftChild == sibling)
+        grandparentNode.leftChild = parent;
+    else
+        grandparentNode.rightChild = parent;
+    setNode(grandparent, grandparentNode);
+    refitUpwards(grandparent);
+}
+
+void BVHEditor::refitUpwards(int nodeIndex)
+{
+    std::vector<Node>& nodes = bvh.nodeList;
+    for (; nodeIndex >= 0; nodeIndex = parents[nodeIndex]) {
+        Node& node = nodes[nodeIndex];
+        AABB bounds = AABB::empty();
+        if (node.isLeaf()) {
+            for (int slot = node.triangleOffset(); slot < node.triangleOffset() + node.triangleCount(); ++slot)
+                bounds.surrounding(primitiveBounds[bvh.triangleIndices[slot]]);
+        } else {
+            bounds = unite(nodes[node.leftChild].aabb, nodes[node.rightChild].aabb);
+        }
+
+        if (bounds.getMin() != node.aabb.getMin() || bounds.getMax() != node.aabb.getMax()) {
+            node.aabb = bounds;
+            dirtyNodes.push_back(nodeIndex);
+        }
+
+        if (settings.rotate && !node.isLeaf())
+            rotate(nodeIndex);
+    }
+}
+
+void BVHEditor::rotate(int nodeIndex)
+{
+    std::vector<Node>& nodes = bvh.nodeList;
+    const Node& node = nodes[nodeIndex];
+
+    // swap one child with a grandchild under the other child, when that child gets smaller;
+    // the node bounds do not change, so ancestors are not affected
+    int bestChild = -1; // child whose grandchild moves up
+    int bestGrandchild = -1;
+    float bestGain = 0.0f;
+
+    const int children[2] = { node.leftChild, node.rightChild };
+    for (int side = 0; side < 2; ++side) {
+        const Node& child = nodes[children[side]];
+        if (child.isLeaf())
+            continue;
+
+        const int other = children[1 - side];
+        const int grandchildren[2] = { child.leftChild, child.rightChild };
+        for (int g = 0; g < 2; ++g) {
+            // other goes down to the place of grandchildren[g]
+            const float area = unite(nodes[other].aabb, nodes[grandchildren[1 - g]].aabb).surfaceArea();
+            const float gain = child.aabb.surfaceArea() - area;
+            if (gain > bestGain) {
+                bestGain = gain;
+                bestChild = side;
+                bestGrandchild = g;
+            }
+        }
+    }
+
+    if (bestChild < 0)
+        return;
+
+    const int childIndex = children[bestChild];
+    const int otherIndex = children[1 - bestChild];
+    Node child = nodes[childIndex];
+    const int grandchildIndex = bestGrandchild == 0 ? child.leftChild : child.rightChild;
+
+    if (bestGrandchild == 0)
+        child.leftChild = otherIndex;
+    else
+        child.rightChild = otherIndex;
+    child.aabb = unite(nodes[child.leftChild].aabb, nodes[child.rightChild].aabb);
+    setNode(childIndex, child);
+
+    Node rotated = nodes[nodeIndex];
+    if (bestChild == 0)
+        rotated.rightChild = grandchildIndex;
+    else
+        rotated.leftChild = grandchildIndex;
+    setNode(nodeIndex, rotated);
+}
+
+BVHEditReport BVHEditor::finishEdits()
+{
+    BVHEditReport report;
+    report.costAfter = bvh.computeSAHCost();
+    if (builtCost <= 0.0f)
+        builtCost = report.costAfter;
+    report.costBefore = builtCost;
+    if (!bvh.triangleIndices.empty())
+        report.freeSlotRatio = float(freeSlots.size()) / bvh.triangleIndices.size();
+
+    if (report.costAfter > builtCost * settings.rebuildCostRatio || report.freeSlotRatio > settings.rebuildFreeSlotRatio) {
+        std::vector<int> livePrimitives;
+        std::vector<AABB> liveBounds;
+        for (int primitive = 0; primitive < (int)primitiveBounds.size(); ++primitive) {
+            if (contains(primitive)) {
+                livePrimitives.push_back(primitive);
+                liveBounds.push_back(primitiveBounds[primitive]);
+            }
+        }
+
+        bvh.build(liveBounds);
+        for (int& primitive : bvh.triangleIndices)
+            primitive = livePrimitives[primitive];
+        attach();
+
+        report.rebuilt = true;
+        report.costAfter = builtCost;
+        report.nodes = { DirtyRange(0, bvh.nodeList.size()) };
+        report.triangleIndices = { DirtyRange(0, bvh.triangleIndices.size()) };
+        dirtyNodes.clear();
+        dirtySlots.clear();
+        return report;
+    }
+
+    report.nodes = takeRanges(dirtyNodes);
+    report.triangleIndices = takeRanges(dirtySlots);
+    return report;
+}
+
+std::vector<DirtyRange> BVHEditor::takeRanges(std::vector<int>& indices) const
+{
+    std::sort(indices.begin(), indices.end());
+    std::vector<DirtyRange> ranges;
+    for (int index : indices) {
+        if (!ranges.empty() && index < ranges.back().end + settings.dirtyRangeGap)
+            ranges.back().include(index);
+        else
+            ranges.emplace_back(index, index + 1);
+    }
+    indices.clear();
+    return ranges;
+}
@@ -0,0 +1,59 @@
+#include "BVHMetrics.h"
+
+BVHMetrics BVHMetrics::compute(const BVHBuilder& bvh)
+{
+    BVHMetrics metrics;
+    const std::vector<Node>& nodes = bvh.getNodes();
+    if (nodes.empty())
+        return metrics;
+
+    metrics.sahCost = bvh.computeSAHCost();
+    metrics.nodeCount = nodes.size();
+    metrics.referenceCount = bvh.getTriangleIndices().size();
+
+    const float rootArea = nodes[0].aabb.surfaceArea();
+    long long leafDepthSum = 0;
+    int overlappingSiblings = 0;
+
+    // <node, depth>, explicit stack, degenerate trees may be as deep as the triangle count
+    std::vector<std::pair<int, int>> stack;
+    stack.push_back({ 0, 0 });
+    while (!stack.empty()) {
+        auto [nodeIndex, depth] = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[nodeIndex];
+
+        if (node.isLeaf()) {
+            metrics.leafCount++;
+            metrics.maxDepth = std::max(metrics.maxDepth, depth);
+            leafDepthSum += depth;
+
+            if ((int)metrics.depthHistogram.size() <= depth)
+                metrics.depthHistogram.resize(depth + 1, 0);
+            metrics.depthHistogram[depth]++;
+
+            if ((int)metrics.leafSizeHistogram.size() <= node.triangleCount())
+                metrics.leafSizeHistogram.resize(node.triangleCount() + 1, 0);
+            metrics.leafSizeHistogram[node.triangleCount()]++;
+            continue;
+        }
+
+        metrics.innerCount++;
+        AABB shared = nodes[node.leftChild].aabb;
+        shared.clip(nodes[node.rightChild].aabb);
+        if (shared.isValid()) {
+            overlappingSiblings++;
+            if (rootArea > 0.0f)
+                metrics.siblingOverlap += shared.surfaceArea() / rootArea;
+        }
+
+        stack.push_back({ node.rightChild, depth + 1 });
+        stack.push_back({ node.leftChild, depth + 1 });
+    }
+
+    metrics.averageLeafDepth = float(leafDepthSum) / metrics.leafCount;
+    metrics.requiredStackSize = metrics.innerCount > 0 ? metrics.maxDepth + 1 : 1;
+    if (metrics.innerCount > 0)
+        metrics.overlappingSiblingRatio = float(overlappingSiblings) / metrics.innerCount;
+    return metrics;
+}
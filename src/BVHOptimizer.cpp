@@ -0,0 +1,211 @@
+#include "BVHOptimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <glm.hpp>
+
+namespace {
+constexpr int maxTreeletSize = 8;
+
+// upper levels of the tree are processed as tasks (up to 2^depth tasks)
+constexpr int optimizeTaskDepth = 10;
+
+int64_t now()
+{
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+}
+
+BVHOptimizer::BVHOptimizer()
+    : BVHOptimizer(BVHOptimizeSettings())
+{
+}
+
+BVHOptimizer::BVHOptimizer(BVHOptimizeSettings const& settings)
+    : settings(settings)
+{
+    this->settings.treeletSize = glm::clamp(settings.treeletSize, 3, maxTreeletSize);
+}
+
+BVHOptimizeReport BVHOptimizer::optimize(BVHBuilder& bvh)
+{
+    BVHOptimizeReport report;
+    report.costBefore = bvh.computeSAHCost();
+    report.costAfter = report.costBefore;
+    if (bvh.nodeList.empty())
+        return report;
+
+    const int64_t start = now();
+    deadline = 0;
+    if (settings.maxMilliseconds > 0.0f) {
+        using namespace std::chrono;
+        deadline = start + duration_cast<steady_clock::duration>(duration<float, std::milli>(settings.maxMilliseconds)).count();
+    }
+
+    this->bvh = &bvh;
+    subtreeCost.assign(bvh.nodeList.size(), 0.0f);
+
+    for (int pass = 0; pass < settings.maxPasses && !timeIsOver(); ++pass) {
+        const int restructuredBefore = restructuredCount;
+        optimizeRecursive(0, 0);
+        report.passes++;
+
+        // converged
+        if (restructuredCount == restructuredBefore)
+            break;
+    }
+
+    report.restructuredTreelets = restructuredCount;
+    report.costAfter = bvh.computeSAHCost();
+    report.milliseconds = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::duration(now() - start))
+                              .count();
+
+    this->bvh = nullptr;
+    std::vector<float>().swap(subtreeCost);
+    restructuredCount = 0;
+    return report;
+}
+
+void BVHOptimizer::optimizeRecursive(int nodeIndex, int depth)
+{
+    const BVHBuildSettings& costs = bvh->settings;
+    const Node& node = bvh->nodeList[nodeIndex];
+
+    if (node.isLeaf()) {
+        subtreeCost[nodeIndex] = costs.intersectionCost * node.triangleCount() * nodeArea(nodeIndex);
+        return;
+    }
+
+    {
+        ThreadPool::TaskGroup group(*bvh->threadPool);
+        const int leftChild = node.leftChild;
+        if (depth < optimizeTaskDepth)
+            group.run([this, leftChild, depth] { optimizeRecursive(leftChild, depth + 1); });
+        else
+            optimizeRecursive(leftChild, depth + 1);
+
+        optimizeRecursive(node.rightChild, depth + 1);
+    }
+
+    subtreeCost[nodeIndex] = costs.traversalCost * nodeArea(nodeIndex)
+        + subtreeCost[node.leftChild] + subtreeCost[node.rightChild];
+
+    if (!timeIsOver())
+        restructureTreelet(nodeIndex);
+}
+
+void BVHOptimizer::restructureTreelet(int rootIndex)
+{
+    std::vector<Node>& nodes = bvh->nodeList;
+
+    // grow treelet: replace the treelet leaf with the largest area by its children
+    int leaves[maxTreeletSize];
+    int internals[maxTreeletSize];
+    int leafCount = 2;
+    int internalCount = 1;
+    leaves[0] = nodes[rootIndex].leftChild;
+    leaves[1] = nodes[rootIndex].rightChild;
+    internals[0] = rootIndex;
+
+    while (leafCount < settings.treeletSize) {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (int i = 0; i < leafCount; ++i) {
+            float area = nodeArea(leaves[i]);
+            if (!nodes[leaves[i]].isLeaf() && area > largestArea) {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if (largest < 0)
+            break;
+
+        const Node& expanded = nodes[leaves[largest]];
+        internals[internalCount++] = leaves[largest];
+        leaves[largest] = expanded.leftChild;
+        leaves[leafCount++] = expanded.rightChild;
+    }
+
+    // two leaves have only one topology
+    if (leafCount < 3)
+        return;
+
+    // optimal topology for every subset of treelet leaves, subsets of S are numerically smaller than S
+    constexpr int maxSubsetCount = 1 << maxTreeletSize;
+    AABB subsetBounds[maxSubsetCount];
+    float subsetCost[maxSubsetCount];
+    int subsetPartition[maxSubsetCount];
+
+    const float traversalCost = bvh->settings.traversalCost;
+    const int subsetCount = 1 << leafCount;
+    for (int subset = 1; subset < subsetCount; ++subset) {
+        const int lowestBit = subset & -subset;
+        const int lowestLeaf = glm::findLSB(lowestBit);
+
+        if (subset == lowestBit) {
+            subsetBounds[subset] = nodes[leaves[lowestLeaf]].aabb;
+            subsetCost[subset] = subtreeCost[leaves[lowestLeaf]];
+            continue;
+        }
+
+        subsetBounds[subset] = subsetBounds[subset ^ lowestBit];
+        subsetBounds[subset].surrounding(subsetBounds[lowestBit]);
+
+        // partitions containing the lowest leaf on the left side, so each split is tested once
+        float bestCost = FLT_MAX;
+        for (int part = (subset - 1) & subset; part > 0; part = (part - 1) & subset) {
+            if (!(part & lowestBit))
+                continue;
+            float cost = subsetCost[part] + subsetCost[subset ^ part];
+            if (cost < bestCost) {
+                bestCost = cost;
+                subsetPartition[subset] = part;
+            }
+        }
+        subsetCost[subset] = traversalCost * subsetBounds[subset].surfaceArea() + bestCost;
+    }
+
+    const int fullSet = subsetCount - 1;
+    if (subsetCost[fullSet] >= subtreeCost[rootIndex] * (1.0f - 1e-6f))
+        return;
+
+    // rewire internal nodes by the optimal partitions, root keeps its index
+    std::pair<int, int> stack[maxTreeletSize]; // <subset, node index>
+    int stackSize = 0;
+    int nextInternal = 1;
+    stack[stackSize++] = { fullSet, rootIndex };
+
+    while (stackSize > 0) {
+        auto [subset, nodeIndex] = stack[--stackSize];
+        const int parts[2] = { subsetPartition[subset], subset ^ subsetPartition[subset] };
+        int children[2];
+
+        for (int i = 0; i < 2; ++i) {
+            if ((parts[i] & (parts[i] - 1)) == 0) {
+                children[i] = leaves[glm::findLSB(parts[i])];
+            } else {
+                children[i] = internals[nextInternal++];
+                stack[stackSize++] = { parts[i], children[i] };
+            }
+        }
+
+        Node& node = nodes[nodeIndex];
+        node.leftChild = children[0];
+        node.rightChild = children[1];
+        node.aabb = subsetBounds[subset];
+        subtreeCost[nodeIndex] = subsetCost[subset];
+    }
+
+    restructuredCount++;
+}
+
+float BVHOptimizer::nodeArea(int nodeIndex) const
+{
+    return bvh->nodeList[nodeIndex].aabb.surfaceArea();
+}
+
+bool BVHOptimizer::timeIsOver() const
+{
+    return deadline != 0 && now() > deadline;
+}
@@ -0,0 +1,140 @@
+#include "BVHTraversal.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+bool BVHTraversal::intersectBox(AABB const& box, glm::vec3 const& origin, glm::vec3 const& invDirection, float tMin, float tMax, float& tNear)
+{
+    glm::vec3 t0 = (box.getMin() - origin) * invDirection;
+    glm::vec3 t1 = (box.getMax() - origin) * invDirection;
+    glm::vec3 tSmall = glm::min(t0, t1);
+    glm::vec3 tBig = glm::max(t0, t1);
+    tNear = glm::max(glm::max(tSmall.x, tSmall.y), glm::max(tSmall.z, tMin));
+    float tFar = glm::min(glm::min(tBig.x, tBig.y), glm::min(tBig.z, tMax));
+    return tNear <= tFar;
+}
+
+glm::vec3 BVHTraversal::safeInverse(glm::vec3 const& direction)
+{
+    constexpr float epsilon = 1e-20f;
+    glm::vec3 inverse;
+    for (int axis = 0; axis < 3; ++axis) {
+        float d = direction[axis];
+        if (std::abs(d) < epsilon)
+            d = d < 0.0f ? -epsilon : epsilon;
+        inverse[axis] = 1.0f / d;
+    }
+    return inverse;
+}
+
+BVHTraversal::SlabRay::SlabRay(Ray const& ray)
+    : origin(ray.origin)
+    , invDirection(safeInverse(ray.direction))
+{
+    for (int axis = 0; axis < 3; ++axis)
+        negative[axis] = invDirection[axis] < 0.0f;
+}
+
+Ray BVHTraversal::cameraRay(glm::vec3 const& location, glm::mat3 const& viewToWorld, glm::vec2 const& resolution, glm::vec2 const& pixel)
+{
+    Ray ray;
+    const glm::vec3 viewDirection = glm::normalize(glm::vec3((pixel - resolution * 0.5f) / resolution.y, 1.0f));
+    ray.origin = location;
+    ray.direction = viewToWorld * viewDirection;
+    ray.tMax = 10000.0f;
+    return ray;
+}
+
+bool BVHTraversal::intersectTriangle(const Model3D& model, int triangle, Ray& ray, RayHit& hit)
+{
+    const glm::ivec3& t = model.triangles[triangle];
+    const glm::vec3& p0 = model.vertices[t[0]].position;
+    glm::vec3 e1 = model.vertices[t[1]].position - p0;
+    glm::vec3 e2 = model.vertices[t[2]].position - p0;
+
+    glm::vec3 p = glm::cross(ray.direction, e2);
+    float invDet = 1.0f / glm::dot(e1, p);
+
+    glm::vec3 toOrigin = ray.origin - p0;
+    float u = glm::dot(toOrigin, p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    glm::vec3 q = glm::cross(toOrigin, e1);
+    float v = glm::dot(ray.direction, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    float distance = glm::dot(e2, q) * invDet;
+    if (!(distance > ray.tMin && distance < ray.tMax))
+        return false;
+
+    ray.tMax = distance;
+    hit.triangle = triangle;
+    hit.t = distance;
+    hit.u = u;
+    hit.v = v;
+    return true;
+}
+
+bool BVHTraversal::intersect(const BVHBuilder& bvh, const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats)
+{
+    const std::vector<int>& triangleIndices = bvh.getTriangleIndices();
+    return intersectNodes(bvh.getNodes(), ray, stats, [&](const Node& leaf, TraversalStats& counters) {
+        bool isHit = false;
+        for (int i = leaf.triangleOffset(); i < leaf.triangleOffset() + leaf.triangleCount(); ++i) {
+            counters.triangleTests++;
+            isHit |= intersectTriangle(model, triangleIndices[i], ray, hit);
+        }
+        return isHit;
+    });
+}
+
+bool BVHTraversal::occluded(const BVHBuilder& bvh, const Model3D& model, Ray const& ray, TraversalStats* stats)
+{
+    const std::vector<int>& triangleIndices = bvh.getTriangleIndices();
+    Ray shadowRay = ray;
+    RayHit hit;
+    return intersectNodes<true>(bvh.getNodes(), shadowRay, stats, [&](const Node& leaf, TraversalStats& counters) {
+        for (int i = leaf.triangleOffset(); i < leaf.triangleOffset() + leaf.triangleCount(); ++i) {
+            counters.triangleTests++;
+            if (intersectTriangle(model, triangleIndices[i], shadowRay, hit))
+                return true;
+        }
+        return false;
+    });
+}
+
+std::vector<uint64_t> BVHTraversal::occluded(const BVHBuilder& bvh, const Model3D& model, std::vector<Ray> const& rays,
+    TraversalStats* stats, ThreadPool* threadPool)
+{
+    constexpr int wordsPerChunk = 16;
+    const int rayCount = int(rays.size());
+    const int wordCount = (rayCount + 63) / 64;
+    std::vector<uint64_t> mask(wordCount, 0);
+
+    // counters per chunk, summed in chunk order afterwards
+    std::vector<TraversalStats> chunkStats(stats ? (wordCount + wordsPerChunk - 1) / wordsPerChunk : 0);
+    auto queryWords = [&](int wordBegin, int wordEnd) {
+        TraversalStats* counters = stats ? &chunkStats[wordBegin / wordsPerChunk] : nullptr;
+        for (int word = wordBegin; word < wordEnd; ++word) {
+            const int rayEnd = std::min(rayCount, (word + 1) * 64);
+            for (int i = word * 64; i < rayEnd; ++i) {
+                if (occluded(bvh, model, rays[i], counters))
+                    mask[word] |= uint64_t(1) << (i % 64);
+            }
+        }
+    };
+
+    if (threadPool)
+        threadPool->parallelFor(0, wordCount, wordsPerChunk, queryWords);
+    else
+        queryWords(0, wordCount);
+
+    for (TraversalStats const& chunk : chunkStats) {
+        stats->nodeVisits += chunk.nodeVisits;
+        stats->stackPushes += chunk.stackPushes;
+        stats->triangleTests += chunk.triangleTests;
+    }
+    return mask;
+}
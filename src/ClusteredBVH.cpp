@@ -0,0 +1,104 @@
+#include "ClusteredBVH.h"
+#include "BVHMetrics.h"
+#include <cassert>
+
+namespace {
+constexpr int pixelsPerNode = 2;
+}
+
+ClusteredBVH::ClusteredBVH()
+    : ClusteredBVH(ClusterSettings())
+{
+}
+
+ClusteredBVH::ClusteredBVH(ClusterSettings const& settings)
+    : settings(settings)
+{
+    assert(settings.tileWidth >= 4 && (settings.tileWidth & (settings.tileWidth - 1)) == 0 && "Tile width must be a power of two >= 4");
+    assert(settings.tileHeight >= 1 && (settings.tileHeight & (settings.tileHeight - 1)) == 0 && "Tile height must be a power of two");
+}
+
+void ClusteredBVH::build(const BVHBuilder& bvh)
+{
+    const std::vector<Node>& binary = bvh.getNodes();
+    nodes.clear();
+    triangleIndices = bvh.getTriangleIndices();
+    maxStackSize = BVHMetrics::compute(bvh).requiredStackSize;
+    if (binary.empty())
+        return;
+
+    // slots are counted in nodes, a pair of siblings takes 2 slots and never crosses a tile row
+    const int tileSlots = settings.tileWidth * settings.tileHeight / pixelsPerNode;
+    std::vector<int> newIndex(binary.size(), -1);
+    newIndex[0] = 0;
+    int slotCount = 2; // the root and one padding slot, so pairs start at even slots
+
+    // parents whose child pair is not placed yet, they root the next treelets
+    std::vector<int> pending;
+    if (!binary[0].isLeaf())
+        pending.push_back(0);
+
+    std::vector<int> candidates;
+    std::vector<int> placed;
+    while (!pending.empty()) {
+        const int treeletRoot = pending.back();
+        pending.pop_back();
+
+        // fill the rest of the current tile, grow by the candidate with the largest area,
+        // visiting it fetches its child pair
+        const int capacity = tileSlots - slotCount % tileSlots;
+        candidates.assign(1, treeletRoot);
+        placed.clear();
+        while (!candidates.empty() && int(placed.size()) * 2 < capacity) {
+            int largest = 0;
+            for (int i = 1; i < (int)candidates.size(); ++i) {
+                if (binary[candidates[i]].aabb.surfaceArea() > binary[candidates[largest]].aabb.surfaceArea())
+                    largest = i;
+            }
+            const int parent = candidates[largest];
+            candidates[largest] = candidates.back();
+            candidates.pop_back();
+            placed.push_back(parent);
+
+            for (int child : { binary[parent].leftChild, binary[parent].rightChild }) {
+                if (!binary[child].isLeaf())
+                    candidates.push_back(child);
+            }
+        }
+
+        for (int parent : placed) {
+            newIndex[binary[parent].leftChild] = slotCount++;
+            newIndex[binary[parent].rightChild] = slotCount++;
+        }
+
+        // the largest remaining subtree is laid out right after this treelet
+        std::sort(candidates.begin(), candidates.end(), [&binary](int a, int b) {
+            return binary[a].aabb.surfaceArea() < binary[b].aabb.surfaceArea();
+        });
+        pending.insert(pending.end(), candidates.begin(), candidates.end());
+    }
+
+    // the padding slot stays an inner node with an empty box, no node refers to it
+    nodes.assign(slotCount, Node());
+    for (Node& node : nodes)
+        node.aabb = AABB::empty();
+
+    for (size_t i = 0; i < binary.size(); ++i) {
+        Node node = binary[i];
+        if (!node.isLeaf()) {
+            node.leftChild = newIndex[node.leftChild];
+            node.rightChild = newIndex[node.rightChild];
+        }
+        nodes[newIndex[i]] = node;
+    }
+}
+
+glm::ivec2 ClusteredBVH::tiledTexel(int pixel, int textureWidth, int tileWidth, int tileHeight)
+{
+    const int tileSize = tileWidth * tileHeight;
+    const int tile = pixel / tileSize;
+    const int inTile = pixel % tileSize;
+    const int tilesPerRow = textureWidth / tileWidth;
+    return glm::ivec2((tile % tilesPerRow) * tileWidth + inTile % tileWidth,
+        (tile / tilesPerRow) * tileHeight + inTile / tileWidth);
+}
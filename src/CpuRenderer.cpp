@@ -0,0 +1,146 @@
+#include "CpuRenderer.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+CpuRenderer::CpuRenderer()
+    : CpuRenderer(CpuRenderSettings())
+{
+}
+
+CpuRenderer::CpuRenderer(CpuRenderSettings const& settings)
+    : settings(settings)
+    , threadPool(std::make_unique<ThreadPool>(settings.threadCount))
+{
+}
+
+void CpuRenderer::render(const BVHBuilder& bvh, const Model3D& model, glm::vec3 const& location, glm::mat3 const& viewToWorld)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const int tileSize = std::max(settings.tileSize, 1);
+    const int tilesX = (settings.width + tileSize - 1) / tileSize;
+    const int tilesY = (settings.height + tileSize - 1) / tileSize;
+    pixels.assign(size_t(settings.width) * settings.height * 3, 0);
+
+    packetWidth = 0;
+    if (settings.packetWidth > 0) {
+        packetBVH.build(bvh, model);
+        packetWidth = packetBVH.selectWidth(settings.packetWidth);
+    }
+
+    // one task per tile, counters are summed in tile order afterwards
+    std::vector<TraversalStats> tileStats(tilesX * tilesY);
+    threadPool->parallelFor(0, tilesX * tilesY, 1, [&](int tileBegin, int tileEnd) {
+        for (int tile = tileBegin; tile < tileEnd; ++tile) {
+            if (packetWidth > 0)
+                renderTilePackets(model, location, viewToWorld, tile % tilesX, tile / tilesX, tileStats[tile]);
+            else
+                renderTile(bvh, model, location, viewToWorld, tile % tilesX, tile / tilesX, tileStats[tile]);
+        }
+    });
+
+    stats = TraversalStats();
+    for (TraversalStats const& tile : tileStats) {
+        stats.nodeVisits += tile.nodeVisits;
+        stats.stackPushes += tile.stackPushes;
+        stats.triangleTests += tile.triangleTests;
+    }
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void CpuRenderer::renderTile(const BVHBuilder& bvh, const Model3D& model, glm::vec3 const& location, glm::mat3 const& viewToWorld,
+    int tileX, int tileY, TraversalStats& tileStats)
+{
+    const int tileSize = std::max(settings.tileSize, 1);
+    const int xEnd = std::min((tileX + 1) * tileSize, settings.width);
+    const int yEnd = std::min((tileY + 1) * tileSize, settings.height);
+
+    for (int y = tileY * tileSize; y < yEnd; ++y) {
+        for (int x = tileX * tileSize; x < xEnd; ++x) {
+            Ray ray = pixelRay(location, viewToWorld, x, y);
+            RayHit hit;
+            BVHTraversal::intersect(bvh, model, ray, hit, &tileStats);
+            shadePixel(model, x, y, ray, hit);
+        }
+    }
+}
+
+void CpuRenderer::renderTilePackets(const Model3D& model, glm::vec3 const& location, glm::mat3 const& viewToWorld,
+    int tileX, int tileY, TraversalStats& tileStats)
+{
+    const int tileSize = std::max(settings.tileSize, 1);
+    const int xEnd = std::min((tileX + 1) * tileSize, settings.width);
+    const int yEnd = std::min((tileY + 1) * tileSize, settings.height);
+
+    // square-ish pixel blocks keep the rays of a packet coherent, blocks cut by the tile edge are partial packets
+    const int blockWidth = packetWidth == 16 ? 4 : packetWidth / 2;
+    const int blockHeight = packetWidth / blockWidth;
+    RayPacket packet;
+    int laneX[RayPacket::maxWidth];
+    int laneY[RayPacket::maxWidth];
+
+    for (int blockY = tileY * tileSize; blockY < yEnd; blockY += blockHeight) {
+        for (int blockX = tileX * tileSize; blockX < xEnd; blockX += blockWidth) {
+            packet.count = 0;
+            for (int y = blockY; y < std::min(blockY + blockHeight, yEnd); ++y) {
+                for (int x = blockX; x < std::min(blockX + blockWidth, xEnd); ++x) {
+                    laneX[packet.count] = x;
+                    laneY[packet.count] = y;
+                    packet.set(packet.count++, pixelRay(location, viewToWorld, x, y));
+                }
+            }
+
+            packetBVH.intersect(packet, &tileStats);
+            for (int lane = 0; lane < packet.count; ++lane)
+                shadePixel(model, laneX[lane], laneY[lane], packet.ray(lane), packet.hit(lane));
+        }
+    }
+}
+
+Ray CpuRenderer::pixelRay(glm::vec3 const& location, glm::mat3 const& viewToWorld, int x, int y) const
+{
+    // pixel centers like gl_FragCoord, which counts rows from the bottom
+    const int row = settings.height - 1 - y;
+    const glm::vec2 resolution(settings.width, settings.height);
+    return BVHTraversal::cameraRay(location, viewToWorld, resolution, glm::vec2(x + 0.5f, row + 0.5f));
+}
+
+void CpuRenderer::shadePixel(const Model3D& model, int x, int y, Ray const& ray, RayHit const& hit)
+{
+    // color = vec4(hit.normal * .5 + 0.5, 1.0), a miss keeps the zero normal
+    const SurfaceHit surfaceHit = surface(model, ray, hit);
+    const glm::vec3 color = surfaceHit.normal * 0.5f + 0.5f;
+    uint8_t* pixel = &pixels[(size_t(y) * settings.width + x) * 3];
+    for (int c = 0; c < 3; ++c)
+        pixel[c] = uint8_t(std::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+SurfaceHit CpuRenderer::surface(const Model3D& model, Ray const& ray, RayHit const& hit)
+{
+    SurfaceHit surfaceHit;
+    if (!hit.isHit())
+        return surfaceHit;
+
+    const glm::ivec3& triangle = model.triangles[hit.triangle];
+    const Vertex& v0 = model.vertices[triangle[0]];
+    const Vertex& v1 = model.vertices[triangle[1]];
+    const Vertex& v2 = model.vertices[triangle[2]];
+    const float w = 1.0f - hit.u - hit.v;
+
+    surfaceHit.position = ray.origin + ray.direction * hit.t;
+    surfaceHit.normal = glm::normalize(v0.normal * w + v1.normal * hit.u + v2.normal * hit.v);
+    surfaceHit.uv = v0.uv * w + v1.uv * hit.u + v2.uv * hit.v;
+    surfaceHit.isHit = true;
+    return surfaceHit;
+}
+
+bool CpuRenderer::writePPM(std::string const& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file << "P6\n"
+         << settings.width << " " << settings.height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    return bool(file);
+}
@@ -0,0 +1,66 @@
+#include "DepthFirstBVH.h"
+#include "BVHMetrics.h"
+#include <cassert>
+
+void DepthFirstBVH::build(const BVHBuilder& bvh)
+{
+    const std::vector<Node>& binary = bvh.getNodes();
+    nodes.clear();
+    nodes.reserve(binary.size());
+    triangleIndices.clear();
+    triangleIndices.reserve(bvh.getTriangleIndices().size());
+
+    int maxLeafSize = 1;
+    for (const Node& node : binary) {
+        if (node.isLeaf())
+            maxLeafSize = std::max(maxLeafSize, node.triangleCount());
+    }
+    leafCountBits = 1;
+    while ((1 << leafCountBits) <= maxLeafSize)
+        ++leafCountBits;
+
+    assert(int64_t(bvh.getTriangleIndices().size()) << leafCountBits <= INT_MAX && "Leaf link overflow");
+    maxStackSize = BVHMetrics::compute(bvh).requiredStackSize;
+
+    if (!binary.empty())
+        emitPreorder(bvh, 0);
+}
+
+void DepthFirstBVH::emitPreorder(const BVHBuilder& bvh, int binaryIndex)
+{
+    const Node& source = bvh.getNodes()[binaryIndex];
+    const int index = nodes.size();
+    nodes.push_back({ source.aabb, 0 });
+
+    if (source.isLeaf()) {
+        const int offset = triangleIndices.size();
+        const auto first = bvh.getTriangleIndices().begin() + source.triangleOffset();
+        triangleIndices.insert(triangleIndices.end(), first, first + source.triangleCount());
+        nodes[index].link = -(offset << leafCountBits | source.triangleCount());
+        return;
+    }
+
+    // nodes may reallocate, so access by index
+    emitPreorder(bvh, source.leftChild);
+    nodes[index].link = nodes.size();
+    emitPreorder(bvh, source.rightChild);
+}
+
+bool DepthFirstBVH::intersect(const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats) const
+{
+    // the left child of an inner node is the next node, the right one is linked
+    struct Children {
+        int left(const DepthFirstNode&, int index) const { return index + 1; }
+        int right(const DepthFirstNode& node, int) const { return node.link; }
+    };
+
+    return BVHTraversal::intersectNodes(nodes, ray, stats, Children(), [&](const DepthFirstNode& leaf, TraversalStats& counters) {
+        bool isHit = false;
+        const int first = triangleOffset(leaf);
+        for (int i = first; i < first + triangleCount(leaf); ++i) {
+            counters.triangleTests++;
+            isHit |= BVHTraversal::intersectTriangle(model, triangleIndices[i], ray, hit);
+        }
+        return isHit;
+    });
+}
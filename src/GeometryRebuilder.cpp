@@ -0,0 +1,120 @@
+#include "GeometryRebuilder.h"
+#include "glad.h" // Opengl function loader
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+#define LOG(x) std::cout << x << std::endl
+
+namespace {
+constexpr int bytesPerPixel = 4 * sizeof(float); // RGBA32F, see GeometryTexture
+}
+
+GeometryRebuilder::GeometryRebuilder()
+    : GeometryRebuilder(GeometryRebuildSettings())
+{
+}
+
+GeometryRebuilder::GeometryRebuilder(GeometryRebuildSettings const& settings)
+    : settings(settings)
+{
+}
+
+bool GeometryRebuilder::request(BuildFunction build)
+{
+    if (state != State::Idle)
+        return false;
+
+    building = std::async(std::launch::async, std::move(build));
+    state = State::Building;
+    return true;
+}
+
+std::optional<GeometryTexture> GeometryRebuilder::poll()
+{
+    switch (state) {
+    case State::Idle:
+        return std::nullopt;
+
+    case State::Building: {
+        if (building.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return std::nullopt;
+
+        // a failed build leaves the current geometry on screen
+        try {
+            pending.emplace(building.get());
+        } catch (std::exception const& e) {
+            LOG("Geometry rebuild failed: " << e.what());
+            state = State::Idle;
+            return std::nullopt;
+        }
+        const GeometryTexture::Layout& layout = pending->getLayout();
+        assert(!pending->getPixels().empty() && "Rebuilt geometry must keep its packed pixels");
+
+        // storage only, rows arrive over the next frames
+        target = std::make_unique<TextureGL>(layout.width, layout.height, TextureGLType::RGBA_32F, nullptr);
+        const size_t rowBytes = size_t(layout.width) * bytesPerPixel;
+        const size_t chunkBytes = std::max<size_t>(1, settings.bytesPerFrame / rowBytes) * rowBytes;
+        if (pixelBuffers.empty() || pixelBuffers[0].getCapacity() < chunkBytes) {
+            pixelBuffers.clear();
+            pixelBuffers.emplace_back(chunkBytes);
+            pixelBuffers.emplace_back(chunkBytes);
+        }
+        nextRow = 0;
+        state = State::Uploading;
+        uploadChunk();
+        return std::nullopt;
+    }
+
+    case State::Uploading:
+        uploadChunk();
+        return std::nullopt;
+
+    case State::Fencing: {
+        GLenum status = glClientWaitSync(static_cast<GLsync>(fence), 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return std::nullopt;
+
+        glDeleteSync(static_cast<GLsync>(fence));
+        fence = nullptr;
+        pending->attachTexture(std::move(target));
+        std::optional<GeometryTexture> ready = std::move(pending);
+        pending.reset();
+        state = State::Idle;
+        LOG("Rebuilt geometry uploaded");
+        return ready;
+    }
+    }
+    return std::nullopt;
+}
+
+void GeometryRebuilder::uploadChunk()
+{
+    const GeometryTexture::Layout& layout = pending->getLayout();
+    const size_t rowBytes = size_t(layout.width) * bytesPerPixel;
+    PixelBufferGL& pixelBuffer = pixelBuffers[nextBuffer];
+    const int rowCount = std::min<int>(pixelBuffer.getCapacity() / rowBytes, layout.height - nextRow);
+
+    // while the GPU copies from one buffer, the next chunk goes to the other one
+    const float* rows = pending->getPixels().data() + size_t(nextRow) * layout.width * 4;
+    pixelBuffer.write(rows, rowCount * rowBytes);
+    target->update(0, nextRow, layout.width, rowCount, pixelBuffer);
+    nextBuffer ^= 1;
+    nextRow += rowCount;
+
+    if (nextRow == layout.height) {
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        state = State::Fencing;
+    }
+}
+
+GeometryRebuilder::~GeometryRebuilder()
+{
+    if (building.valid())
+        building.wait();
+    if (fence)
+        glDeleteSync(static_cast<GLsync>(fence));
+}
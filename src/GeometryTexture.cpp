@@ -0,0 +1,552 @@
+#include "GeometryTexture.h"
+#include "BVHMetrics.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+// reinterpret integers (tri indices, vert indices) to float texture
+// advantage - create bigger than 16777216 pixel texture
+// drawbacks - some drivers do calculation with NEAREST texture sample as well, so data can be corrupted
+// to fetch int data in shader - use floatBitsToInt(...)
+// apply the same macro in raytracing shader!
+
+#define REINTERPRET_FLOAT_DATA
+// Nvidia propietary 530 driver works fine, Intel Mesa - does some mess.
+
+#define LOG(x) std::cout << x << std::endl
+
+namespace {
+constexpr int floatsPerPixel = 4;
+constexpr auto format = TextureGLType::RGBA_32F;
+
+constexpr int nFloatsInNode = 8;
+constexpr int nFloatsInIndex = 4;
+constexpr int nFloatsInVertex = 8;
+constexpr int nPixelPerNode = nFloatsInNode / floatsPerPixel;
+constexpr int nPixelPerIndex = nFloatsInIndex / floatsPerPixel;
+constexpr int nPixelPerVertex = nFloatsInVertex / floatsPerPixel;
+
+// 3 matrix rows, bottom-level root and instance index
+constexpr int nPixelPerInstance = 4;
+
+// 8 pixels per 4 children, see GeometryTexture.h
+constexpr int nPixelPerWideNode(int width) { return width * 2; }
+
+// header, children, then 6 planes of 4 codes and the triangle count word rounded up to pixels
+constexpr int nPixelPerQuantizedNode(int bits) { return 2 + (6 * bits / 8 + 1 + floatsPerPixel - 1) / floatsPerPixel; }
+
+int withHeadroom(int count, float headroom)
+{
+    return count + int(std::ceil(count * headroom));
+}
+
+// edits of a texture with headroom may deepen the tree, so it never gets less than the shader default
+int stackSizeWithHeadroom(const BVHBuilder& bvh, float headroom)
+{
+    const int required = BVHMetrics::compute(bvh).requiredStackSize;
+    return headroom > 0.0f ? std::max(required, BVHMetrics::shaderStackSize) : required;
+}
+
+// bottom-level traversals share one stack, so it is sized for the deepest mesh
+int bottomLevelStackSize(const TwoLevelBVH& scene)
+{
+    int stackSize = 1;
+    for (const TwoLevelBVH::Mesh& mesh : scene.getMeshes())
+        stackSize = std::max(stackSize, BVHMetrics::compute(*mesh.bvh).requiredStackSize);
+    return stackSize;
+}
+
+float packUint(uint32_t value)
+{
+    return reinterpret_cast<float&>(value);
+}
+
+float packInt(int value)
+{
+#ifdef REINTERPRET_FLOAT_DATA
+    return reinterpret_cast<float&>(value);
+#else
+    return float(value);
+#endif
+}
+}
+
+GeometryTexture::Layout GeometryTexture::computeLayout(int nodePixelCount, int triangleCount, int vertexCount)
+{
+    Layout layout;
+    layout.nodePixelCount = nodePixelCount;
+
+    // calculate index buffer size, SBVH can reference a triangle several times
+    int numOfFloatsInIndexArray = triangleCount * nFloatsInIndex;
+    layout.indexPixelCount = numOfFloatsInIndexArray / floatsPerPixel;
+
+    // calculate vertex buffer size
+    int numOfFloatsInVertexArray = vertexCount * nFloatsInVertex;
+    layout.vertexPixelCount = numOfFloatsInVertexArray / floatsPerPixel;
+
+    int overallPixelCount = layout.nodePixelCount + layout.indexPixelCount + layout.vertexPixelCount;
+    overallPixelCount = Utils::powerOfTwo(overallPixelCount);
+
+#ifndef REINTERPRET_FLOAT_DATA
+    assert(overallPixelCount <= 16777216 && "You can not sample more than 16777216 index with float indices");
+#endif
+
+    layout.width = Utils::powerOfTwo(sqrtf(overallPixelCount));
+    layout.height = overallPixelCount / layout.width;
+    return layout;
+}
+
+GeometryTexture::Layout GeometryTexture::computeTiledLayout(int nodePixelCount, int triangleCount, int vertexCount, int tileHeight)
+{
+    Layout layout = computeLayout(nodePixelCount, triangleCount, vertexCount);
+    for (;;) {
+        const int tileRow = layout.width * tileHeight;
+        const int padded = (nodePixelCount + tileRow - 1) / tileRow * tileRow;
+        Layout tiled = computeLayout(padded, triangleCount, vertexCount);
+        if (tiled.width == layout.width)
+            return tiled;
+        layout = tiled;
+    }
+}
+
+GeometryTexture::Layout GeometryTexture::computeInstancedLayout(const TwoLevelBVH& scene)
+{
+    const BVHBuilder& topLevel = scene.getTopLevel();
+    int nodePixelCount = topLevel.getNodes().size() * nPixelPerNode + topLevel.getTriangleIndices().size() * nPixelPerInstance;
+    int triangleCount = 0;
+    int vertexCount = 0;
+    for (const TwoLevelBVH::Mesh& mesh : scene.getMeshes()) {
+        nodePixelCount += mesh.bvh->getNodes().size() * nPixelPerNode;
+        triangleCount += mesh.bvh->getTriangleIndices().size();
+        vertexCount += mesh.model->vertices.size();
+    }
+    return computeLayout(nodePixelCount, triangleCount, vertexCount);
+}
+
+GeometryTexture::GeometryTexture(const BVHBuilder& bvh, const Model3D& model, float headroom)
+    : layout(computeLayout(withHeadroom(bvh.getNodes().size(), headroom) * nPixelPerNode,
+          withHeadroom(bvh.getTriangleIndices().size(), headroom), withHeadroom(model.vertices.size(), headroom)))
+    , buffer(layout.width * layout.height * floatsPerPixel, 0)
+    , shaderDefines("#define STACK_SIZE " + std::to_string(stackSizeWithHeadroom(bvh, headroom)) + "\n")
+{
+    packNodes(bvh.getNodes(), 0, bvh.getNodes().size(), 0, layout.nodePixelCount, nPixelPerIndex);
+    packGeometry(bvh.getTriangleIndices(), model);
+}
+
+GeometryTexture::GeometryTexture(const ClusteredBVH& bvh, const Model3D& model)
+    : layout(computeTiledLayout(bvh.getNodes().size() * nPixelPerNode, bvh.getTriangleIndices().size(), model.vertices.size(), bvh.getSettings().tileHeight))
+    , buffer(layout.width * layout.height * floatsPerPixel, 0)
+    , shaderDefines("#define NODE_TILE_WIDTH " + std::to_string(bvh.getSettings().tileWidth)
+          + "\n#define NODE_TILE_HEIGHT " + std::to_string(bvh.getSettings().tileHeight)
+          + "\n#define STACK_SIZE " + std::to_string(bvh.getMaxStackSize()) + "\n")
+{
+    assert(layout.width % bvh.getSettings().tileWidth == 0 && "Texture is narrower than a tile");
+    packNodes(bvh.getNodes(), 0, bvh.getNodes().size(), 0, layout.nodePixelCount, nPixelPerIndex);
+    tileNodes(bvh.getSettings().tileWidth, bvh.getSettings().tileHeight);
+    packGeometry(bvh.getTriangleIndices(), model);
+}
+
+template <int Width>
+GeometryTexture::GeometryTexture(const WideBVH<Width>& bvh, const Model3D& model)
+    : layout(computeLayout(bvh.getNodes().size() * nPixelPerWideNode(Width), bvh.getTriangleIndices().size(), model.vertices.size()))
+    , buffer(layout.width * layout.height * floatsPerPixel, 0)
+    , shaderDefines("#define BVH_WIDTH " + std::to_string(Width) + "\n#define STACK_SIZE " + std::to_string(bvh.getMaxStackSize()) + "\n")
+{
+    packWideNodes(bvh);
+    packGeometry(bvh.getTriangleIndices(), model);
+}
+
+GeometryTexture::GeometryTexture(const TwoLevelBVH& scene)
+    : layout(computeInstancedLayout(scene))
+    , buffer(layout.width * layout.height * floatsPerPixel, 0)
+    , shaderDefines("#define BVH_INSTANCED\n#define TOP_STACK_SIZE "
+          + std::to_string(BVHMetrics::compute(scene.getTopLevel()).requiredStackSize)
+          + "\n#define STACK_SIZE " + std::to_string(bottomLevelStackSize(scene)) + "\n")
+{
+    packInstances(scene);
+}
+
+GeometryTexture::GeometryTexture(const DepthFirstBVH& bvh, const Model3D& model)
+    : layout(computeLayout(bvh.getNodes().size() * nPixelPerNode, bvh.getTriangleIndices().size(), model.vertices.size()))
+    , buffer(layout.width * layout.height * floatsPerPixel, 0)
+    , shaderDefines("#define BVH_DEPTH_FIRST\n#define BVH_LEAF_COUNT_BITS " + std::to_string(bvh.getLeafCountBits())
+          + "\n#define BVH_INDEX_BEGIN " + std::to_string(layout.nodePixelCount)
+          + "\n#define STACK_SIZE " + std::to_string(bvh.getMaxStackSize()) + "\n")
+{
+    packDepthFirstNodes(bvh);
+    packGeometry(bvh.getTriangleIndices(), model);
+}
+
+GeometryTexture::GeometryTexture(const SkipBVH& bvh, const Model3D& model)
+    : layout(computeLayout(bvh.getNodes().size() * nPixelPerNode, bvh.getTriangleIndices().size(), model.vertices.size()))
+    , buffer(layout.width * layout.height * floatsPerPixel, 0)
+    , shaderDefines("#define BVH_SKIP_LINKS\n#define BVH_NODE_END " + std::to_string(layout.nodePixelCount) + "\n")
+{
+    packSkipNodes(bvh);
+    packGeometry(bvh.getTriangleIndices(), model);
+}
+
+GeometryTexture::GeometryTexture(Layout const& layout, const float* pixels, std::string const& shaderDefines)
+    : layout(layout)
+    , texture(std::make_unique<TextureGL>(layout.width, layout.height, format, pixels))
+    , shaderDefines(shaderDefines)
+{
+    LOG("TextureResolution: " << layout.width << "x" << layout.height << " (cached)");
+}
+
+void GeometryTexture::packGeometry(const std::vector<int>& triangleIndices, const Model3D& model)
+{
+    const int vertexPixelOffset = layout.nodePixelCount + layout.indexPixelCount;
+    packTriangles(triangleIndices, model, 0, triangleIndices.size(), layout.nodePixelCount, vertexPixelOffset);
+    packVertices(model, 0, model.vertices.size(), vertexPixelOffset);
+
+    LOG("Node pixel count: " << layout.nodePixelCount
+                             << ", Index pixel count: " << layout.indexPixelCount
+                             << ", Vertex pixel count: " << layout.vertexPixelCount);
+    LOG("TextureResolution: " << layout.width << "x" << layout.height);
+}
+
+void GeometryTexture::updateNodes(const BVHBuilder& bvh, DirtyRange nodes)
+{
+    if (nodes.isEmpty())
+        return;
+
+    assert(!buffer.empty() && "Cached texture can not be updated");
+    assert(shaderDefines.empty() && "Binary node format only");
+    assert((int)bvh.getNodes().size() * nPixelPerNode <= layout.nodePixelCount && "Nodes outgrew the texture, create new texture");
+    packNodes(bvh.getNodes(), nodes.begin, nodes.end, 0, layout.nodePixelCount, nPixelPerIndex);
+    uploadPixels(nodes.begin * nPixelPerNode, nodes.end * nPixelPerNode);
+}
+
+void GeometryTexture::updateTriangleIndices(const BVHBuilder& bvh, const Model3D& model, DirtyRange triangleIndices)
+{
+    if (triangleIndices.isEmpty())
+        return;
+
+    assert(!buffer.empty() && "Cached texture can not be updated");
+    assert(shaderDefines.empty() && "Binary node format only");
+    assert((int)bvh.getTriangleIndices().size() * nPixelPerIndex <= layout.indexPixelCount && "Triangle indices outgrew the texture, create new texture");
+    packTriangles(bvh.getTriangleIndices(), model, triangleIndices.begin, triangleIndices.end,
+        layout.nodePixelCount, layout.nodePixelCount + layout.indexPixelCount);
+    uploadPixels(layout.nodePixelCount + triangleIndices.begin * nPixelPerIndex, layout.nodePixelCount + triangleIndices.end * nPixelPerIndex);
+}
+
+bool GeometryTexture::hasRoomFor(const BVHBuilder& bvh, const Model3D& model) const
+{
+    return !buffer.empty()
+        && (int)bvh.getNodes().size() * nPixelPerNode <= layout.nodePixelCount
+        && (int)bvh.getTriangleIndices().size() * nPixelPerIndex <= layout.indexPixelCount
+        && (int)model.vertices.size() * nPixelPerVertex <= layout.vertexPixelCount;
+}
+
+void GeometryTexture::updateVertices(const Model3D& model, DirtyRange vertices)
+{
+    if (vertices.isEmpty())
+        return;
+
+    assert(!buffer.empty() && "Cached texture can not be updated");
+    assert((int)model.vertices.size() * nPixelPerVertex <= layout.vertexPixelCount && "Vertices outgrew the texture, create new texture");
+    const int vertexPixelOffset = layout.nodePixelCount + layout.indexPixelCount;
+    packVertices(model, vertices.begin, vertices.end, vertexPixelOffset);
+    uploadPixels(vertexPixelOffset + vertices.begin * nPixelPerVertex, vertexPixelOffset + vertices.end * nPixelPerVertex);
+}
+
+void GeometryTexture::packNodes(const std::vector<Node>& nodes, int begin, int end, int firstPixel, int leafPixel, int leafStride)
+{
+    float* pixels = buffer.data() + firstPixel * floatsPerPixel;
+
+    for (int i = begin; i < end; ++i) {
+        const auto& n = nodes[i];
+
+        // leaf: pixel of the first triangle and minus triangle count
+        // inner node: pixels of both children
+        int leftChildIndex = n.isLeaf()
+            ? n.triangleOffset() * leafStride + leafPixel
+            : n.leftChild * nPixelPerNode + firstPixel;
+
+        int rightChildIndex = n.isLeaf()
+            ? -n.triangleCount()
+            : n.rightChild * nPixelPerNode + firstPixel;
+
+        // first pixel
+        pixels[i * nFloatsInNode + 0] = packInt(leftChildIndex);
+        pixels[i * nFloatsInNode + 1] = packInt(rightChildIndex);
+        pixels[i * nFloatsInNode + 2] = n.aabb.getMin().x;
+        pixels[i * nFloatsInNode + 3] = n.aabb.getMin().y;
+
+        // second pixel
+        pixels[i * nFloatsInNode + 4] = n.aabb.getMin().z;
+        pixels[i * nFloatsInNode + 5] = n.aabb.getMax().x;
+        pixels[i * nFloatsInNode + 6] = n.aabb.getMax().y;
+        pixels[i * nFloatsInNode + 7] = n.aabb.getMax().z;
+    }
+}
+
+template <int Width>
+void GeometryTexture::packWideNodes(const WideBVH<Width>& bvh)
+{
+    const int triangleIndexPixelOffset = layout.nodePixelCount;
+
+    for (size_t i = 0; i < bvh.getNodes().size(); ++i) {
+        const auto& n = bvh.getNodes()[i];
+        float* pixels = buffer.data() + i * nPixelPerWideNode(Width) * floatsPerPixel;
+
+        for (int group = 0; group < Width / 4; ++group) {
+            float* groupPixels = pixels + group * 8 * floatsPerPixel;
+
+            for (int lane = 0; lane < 4; ++lane) {
+                const int slot = group * 4 + lane;
+                for (int axis = 0; axis < 3; ++axis) {
+                    groupPixels[axis * floatsPerPixel + lane] = n.boundsMin[axis][slot];
+                    groupPixels[(axis + 3) * floatsPerPixel + lane] = n.boundsMax[axis][slot];
+                }
+
+                // leaf: pixel of the first triangle, inner child: pixel of the node, empty: -1
+                int child = n.child[slot];
+                if (!n.isEmpty(slot)) {
+                    child = n.isLeaf(slot)
+                        ? child * nPixelPerIndex + triangleIndexPixelOffset
+                        : child * nPixelPerWideNode(Width);
+                }
+                groupPixels[6 * floatsPerPixel + lane] = packInt(child);
+                groupPixels[7 * floatsPerPixel + lane] = packInt(n.triangleCount[slot]);
+            }
+        }
+    }
+}
+
+template <typename Quant>
+void GeometryTexture::packQuantizedNodes(const QuantizedBVH<Quant>& bvh)
+{
+#ifndef REINTERPRET_FLOAT_DATA
+#error "Quantized nodes store packed integers, REINTERPRET_FLOAT_DATA is required"
+#endif
+    constexpr int width = QuantizedNode<Quant>::width;
+    constexpr int bits = QuantizedBVH<Quant>::bits;
+    constexpr int codesPerWord = 32 / bits;
+    const int triangleIndexPixelOffset = layout.nodePixelCount;
+
+    for (size_t i = 0; i < bvh.getNodes().size(); ++i) {
+        const auto& n = bvh.getNodes()[i];
+        float* words = buffer.data() + i * nPixelPerQuantizedNode(bits) * floatsPerPixel;
+
+        // first pixel: node box origin and exponents
+        words[0] = n.origin[0];
+        words[1] = n.origin[1];
+        words[2] = n.origin[2];
+        words[3] = packUint(n.exponent[0] | n.exponent[1] << 8 | n.exponent[2] << 16);
+
+        // second pixel: leaf - pixel of the first triangle, inner child - pixel of the node, empty: -1
+        for (int slot = 0; slot < width; ++slot) {
+            int child = n.child[slot];
+            if (child >= 0) {
+                child = n.triangleCount[slot] > 0
+                    ? child * nPixelPerIndex + triangleIndexPixelOffset
+                    : child * nPixelPerQuantizedNode(bits);
+            }
+            words[floatsPerPixel + slot] = packInt(child);
+        }
+
+        // planes minX, minY, minZ, maxX, maxY, maxZ, lower slots in lower bits
+        int word = 2 * floatsPerPixel;
+        for (int plane = 0; plane < 6; ++plane) {
+            const Quant* codes = plane < 3 ? n.boundsMin[plane] : n.boundsMax[plane - 3];
+            for (int first = 0; first < width; first += codesPerWord) {
+                uint32_t packed = 0;
+                for (int slot = first; slot < first + codesPerWord; ++slot)
+                    packed |= uint32_t(codes[slot]) << ((slot - first) * bits);
+                words[word++] = packUint(packed);
+            }
+        }
+
+        uint32_t counts = 0;
+        for (int slot = 0; slot < width; ++slot)
+            counts |= uint32_t(n.triangleCount[slot]) << (slot * 8);
+        words[word] = packUint(counts);
+    }
+}
+
+void GeometryTexture::tileNodes(int tileWidth, int tileHeight)
+{
+    const std::vector<float> linear(buffer.begin(), buffer.begin() + layout.nodePixelCount * floatsPerPixel);
+    for (int pixel = 0; pixel < layout.nodePixelCount; ++pixel) {
+        glm::ivec2 texel = ClusteredBVH::tiledTexel(pixel, layout.width, tileWidth, tileHeight);
+        std::copy_n(linear.begin() + pixel * floatsPerPixel, floatsPerPixel,
+            buffer.begin() + (texel.y * layout.width + texel.x) * floatsPerPixel);
+    }
+}
+
+void GeometryTexture::packDepthFirstNodes(const DepthFirstBVH& bvh)
+{
+    static_assert(nPixelPerIndex == 1, "Leaf links store the triangle offset in index pixels");
+
+    for (size_t i = 0; i < bvh.getNodes().size(); ++i) {
+        const auto& n = bvh.getNodes()[i];
+        int link = n.isLeaf() ? n.link : n.link * nPixelPerNode;
+
+        buffer[i * nFloatsInNode + 0] = packInt(link);
+        buffer[i * nFloatsInNode + 1] = 0.0f;
+        buffer[i * nFloatsInNode + 2] = n.aabb.getMin().x;
+        buffer[i * nFloatsInNode + 3] = n.aabb.getMin().y;
+        buffer[i * nFloatsInNode + 4] = n.aabb.getMin().z;
+        buffer[i * nFloatsInNode + 5] = n.aabb.getMax().x;
+        buffer[i * nFloatsInNode + 6] = n.aabb.getMax().y;
+        buffer[i * nFloatsInNode + 7] = n.aabb.getMax().z;
+    }
+}
+
+void GeometryTexture::packSkipNodes(const SkipBVH& bvh)
+{
+    const int triangleIndexPixelOffset = layout.nodePixelCount;
+
+    for (size_t i = 0; i < bvh.getNodes().size(); ++i) {
+        const auto& n = bvh.getNodes()[i];
+
+        // a leaf always continues with the next node, so it has room for its triangle range
+        assert((!n.isLeaf() || n.skip == int(i) + 1) && "Skip nodes must be in preorder");
+        int first = n.isLeaf()
+            ? n.triangleOffset * nPixelPerIndex + triangleIndexPixelOffset
+            : n.skip * nPixelPerNode;
+        int second = n.isLeaf() ? -n.triangleCount : 0;
+
+        buffer[i * nFloatsInNode + 0] = packInt(first);
+        buffer[i * nFloatsInNode + 1] = packInt(second);
+        buffer[i * nFloatsInNode + 2] = n.aabb.getMin().x;
+        buffer[i * nFloatsInNode + 3] = n.aabb.getMin().y;
+        buffer[i * nFloatsInNode + 4] = n.aabb.getMin().z;
+        buffer[i * nFloatsInNode + 5] = n.aabb.getMax().x;
+        buffer[i * nFloatsInNode + 6] = n.aabb.getMax().y;
+        buffer[i * nFloatsInNode + 7] = n.aabb.getMax().z;
+    }
+}
+
+void GeometryTexture::packInstances(const TwoLevelBVH& scene)
+{
+    const BVHBuilder& topLevel = scene.getTopLevel();
+    const std::vector<int>& instanceIndices = topLevel.getTriangleIndices();
+    const int recordPixel = topLevel.getNodes().size() * nPixelPerNode;
+    packNodes(topLevel.getNodes(), 0, topLevel.getNodes().size(), 0, recordPixel, nPixelPerInstance);
+
+    // every mesh once, its sections follow the ones of the previous mesh
+    std::vector<int> rootPixel;
+    int nodePixel = recordPixel + instanceIndices.size() * nPixelPerInstance;
+    int indexPixel = layout.nodePixelCount;
+    int vertexPixel = layout.nodePixelCount + layout.indexPixelCount;
+    for (const TwoLevelBVH::Mesh& mesh : scene.getMeshes()) {
+        const std::vector<Node>& nodes = mesh.bvh->getNodes();
+        const std::vector<int>& triangleIndices = mesh.bvh->getTriangleIndices();
+        rootPixel.push_back(nodePixel);
+
+        packNodes(nodes, 0, nodes.size(), nodePixel, indexPixel, nPixelPerIndex);
+        packTriangles(triangleIndices, *mesh.model, 0, triangleIndices.size(), indexPixel, vertexPixel);
+        packVertices(*mesh.model, 0, mesh.model->vertices.size(), vertexPixel);
+
+        nodePixel += nodes.size() * nPixelPerNode;
+        indexPixel += triangleIndices.size() * nPixelPerIndex;
+        vertexPixel += mesh.model->vertices.size() * nPixelPerVertex;
+    }
+
+    for (size_t i = 0; i < instanceIndices.size(); ++i) {
+        const MeshInstance& instance = scene.getInstances()[instanceIndices[i]];
+        float* pixels = buffer.data() + (recordPixel + i * nPixelPerInstance) * floatsPerPixel;
+
+        // dot(row, vec4(p, 1)) is the object space point, dot(row.xyz, d) the direction
+        for (int row = 0; row < 3; ++row)
+            for (int column = 0; column < 4; ++column)
+                pixels[row * floatsPerPixel + column] = instance.inverse[column][row];
+
+        pixels[3 * floatsPerPixel + 0] = packInt(rootPixel[instance.mesh]);
+        pixels[3 * floatsPerPixel + 1] = packInt(instanceIndices[i]);
+        pixels[3 * floatsPerPixel + 2] = 0.0f;
+        pixels[3 * floatsPerPixel + 3] = 0.0f;
+    }
+
+    LOG("Instances: " << instanceIndices.size() << ", meshes: " << scene.getMeshes().size());
+    LOG("Node pixel count: " << layout.nodePixelCount
+                             << ", Index pixel count: " << layout.indexPixelCount
+                             << ", Vertex pixel count: " << layout.vertexPixelCount);
+    LOG("TextureResolution: " << layout.width << "x" << layout.height);
+}
+
+void GeometryTexture::packTriangles(const std::vector<int>& triangleIndices, const Model3D& model, int begin, int end, int firstPixel, int vertexPixel)
+{
+    const int floatOffset = firstPixel * floatsPerPixel;
+
+    // in leaf order, so every leaf is a contiguous run of triangles
+    for (int i = begin; i < end; ++i) {
+        const auto& t = model.triangles[triangleIndices[i]];
+
+        int t0 = t[0] * nPixelPerVertex + vertexPixel;
+        int t1 = t[1] * nPixelPerVertex + vertexPixel;
+        int t2 = t[2] * nPixelPerVertex + vertexPixel;
+
+        buffer[floatOffset + i * nFloatsInIndex + 0] = packInt(t0);
+        buffer[floatOffset + i * nFloatsInIndex + 1] = packInt(t1);
+        buffer[floatOffset + i * nFloatsInIndex + 2] = packInt(t2);
+        buffer[floatOffset + i * nFloatsInIndex + 3] = 0;
+    }
+}
+
+void GeometryTexture::packVertices(const Model3D& model, int begin, int end, int firstPixel)
+{
+    const int floatOffset = firstPixel * floatsPerPixel;
+
+    for (int i = begin; i < end; ++i) {
+        const auto& v = model.vertices[i];
+
+        // first pixel
+        buffer[floatOffset + i * nFloatsInVertex + 0] = v.position.x;
+        buffer[floatOffset + i * nFloatsInVertex + 1] = v.position.y;
+        buffer[floatOffset + i * nFloatsInVertex + 2] = v.position.z;
+        buffer[floatOffset + i * nFloatsInVertex + 3] = v.normal.x;
+
+        // second pixel
+        buffer[floatOffset + i * nFloatsInVertex + 4] = v.normal.y;
+        buffer[floatOffset + i * nFloatsInVertex + 5] = v.normal.z;
+        buffer[floatOffset + i * nFloatsInVertex + 6] = v.uv.x;
+        buffer[floatOffset + i * nFloatsInVertex + 7] = v.uv.y;
+    }
+}
+
+TextureGL& GeometryTexture::getTexture()
+{
+    if (!texture)
+        texture = std::make_unique<TextureGL>(layout.width, layout.height, format, buffer.data());
+    return *texture;
+}
+
+void GeometryTexture::attachTexture(std::unique_ptr<TextureGL> uploaded)
+{
+    assert(uploaded->getWidth() == layout.width && uploaded->getHeight() == layout.height && "Texture does not match the layout");
+    texture = std::move(uploaded);
+}
+
+void GeometryTexture::uploadPixels(int firstPixel, int endPixel)
+{
+    // not created yet, getTexture() uploads everything
+    if (!texture)
+        return;
+
+    const int firstRow = firstPixel / layout.width;
+    const int endRow = (endPixel - 1) / layout.width + 1;
+    const float* rows = buffer.data() + firstRow * layout.width * floatsPerPixel;
+    texture->update(0, firstRow, layout.width, endRow - firstRow, rows);
+}
+
+template <typename Quant>
+GeometryTexture::GeometryTexture(const QuantizedBVH<Quant>& bvh, const Model3D& model)
+    : layout(computeLayout(bvh.getNodes().size() * nPixelPerQuantizedNode(QuantizedBVH<Quant>::bits), bvh.getTriangleIndices().size(), model.vertices.size()))
+    , buffer(layout.width * layout.height * floatsPerPixel, 0)
+    , shaderDefines("#define BVH_WIDTH 4\n#define BVH_QUANTIZED " + std::to_string(QuantizedBVH<Quant>::bits)
+          + "\n#define STACK_SIZE " + std::to_string(bvh.getMaxStackSize()) + "\n")
+{
+    packQuantizedNodes(bvh);
+    packGeometry(bvh.getTriangleIndices(), model);
+}
+
+template GeometryTexture::GeometryTexture(const WideBVH<4>& bvh, const Model3D& model);
+template GeometryTexture::GeometryTexture(const WideBVH<8>& bvh, const Model3D& model);
+template GeometryTexture::GeometryTexture(const QuantizedBVH<uint8_t>& bvh, const Model3D& model);
+template GeometryTexture::GeometryTexture(const QuantizedBVH<uint16_t>& bvh, const Model3D& model);
@@ -0,0 +1,276 @@
+#include "PacketBVH.h"
+#include "BVHMetrics.h"
+#include "PacketKernel.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PACKET_KERNELS_X86
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// PacketKernels*.cpp, each built for its instruction set
+long long intersectPacketSSE2(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack);
+long long intersectPacketAVX2(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack);
+long long intersectPacketAVX512(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack);
+long long occludedPacketSSE2(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack);
+long long occludedPacketAVX2(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack);
+long long occludedPacketAVX512(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack);
+#endif
+
+namespace {
+// plain C++ lanes for CPUs without a kernel, compilers may vectorize the loops
+struct LanesScalar {
+    static constexpr int width = 4;
+    struct F {
+        float lane[width];
+    };
+    using M = unsigned;
+
+    template <typename Operation>
+    static F map(F a, F b, Operation operation)
+    {
+        F result;
+        for (int i = 0; i < width; ++i)
+            result.lane[i] = operation(a.lane[i], b.lane[i]);
+        return result;
+    }
+
+    template <typename Compare>
+    static M compare(F a, F b, Compare compare)
+    {
+        M result = 0;
+        for (int i = 0; i < width; ++i)
+            result |= M(compare(a.lane[i], b.lane[i])) << i;
+        return result;
+    }
+
+    static F load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+    static void store(float* p, F a) { std::copy(a.lane, a.lane + width, p); }
+    static F broadcast(float a) { return { { a, a, a, a } }; }
+    static F add(F a, F b) { return map(a, b, [](float x, float y) { return x + y; }); }
+    static F sub(F a, F b) { return map(a, b, [](float x, float y) { return x - y; }); }
+    static F mul(F a, F b) { return map(a, b, [](float x, float y) { return x * y; }); }
+    static F div(F a, F b) { return map(a, b, [](float x, float y) { return x / y; }); }
+    static F min(F a, F b) { return map(a, b, [](float x, float y) { return y < x ? y : x; }); }
+    static F max(F a, F b) { return map(a, b, [](float x, float y) { return x < y ? y : x; }); }
+    static M lt(F a, F b) { return compare(a, b, [](float x, float y) { return x < y; }); }
+    static M le(F a, F b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+    static M gt(F a, F b) { return compare(a, b, [](float x, float y) { return x > y; }); }
+    static M maskAnd(M a, M b) { return a & b; }
+    static M maskOr(M a, M b) { return a | b; }
+    static M maskNot(M a) { return ~a & ((1u << width) - 1); }
+    static unsigned bits(M a) { return a; }
+    static F select(M mask, F a, F b)
+    {
+        F result;
+        for (int i = 0; i < width; ++i)
+            result.lane[i] = (mask >> i & 1) ? a.lane[i] : b.lane[i];
+        return result;
+    }
+    static M firstLanes(int count) { return count >= width ? (1u << width) - 1 : (1u << count) - 1; }
+};
+}
+
+void RayPacket::set(int lane, Ray const& ray)
+{
+    assert(lane >= 0 && lane < maxWidth && "Lane out of packet");
+    const glm::vec3 inverse = BVHTraversal::safeInverse(ray.direction);
+    for (int a = 0; a < 3; ++a) {
+        origin[a][lane] = ray.origin[a];
+        direction[a][lane] = ray.direction[a];
+        invDirection[a][lane] = inverse[a];
+    }
+    tMin[lane] = ray.tMin;
+    tMax[lane] = ray.tMax;
+    u[lane] = 0.0f;
+    v[lane] = 0.0f;
+    triangle[lane] = -1;
+}
+
+Ray RayPacket::ray(int lane) const
+{
+    Ray ray;
+    ray.origin = glm::vec3(origin[0][lane], origin[1][lane], origin[2][lane]);
+    ray.direction = glm::vec3(direction[0][lane], direction[1][lane], direction[2][lane]);
+    ray.tMin = tMin[lane];
+    ray.tMax = tMax[lane];
+    return ray;
+}
+
+RayHit RayPacket::hit(int lane) const
+{
+    RayHit hit;
+    if (triangle[lane] < 0)
+        return hit;
+    hit.triangle = triangle[lane];
+    hit.t = tMax[lane];
+    hit.u = u[lane];
+    hit.v = v[lane];
+    return hit;
+}
+
+PacketBVH::PacketBVH()
+    : instructionSet(detectInstructionSet())
+{
+}
+
+void PacketBVH::build(const BVHBuilder& bvh, const Model3D& model)
+{
+    const std::vector<Node>& source = bvh.getNodes();
+    stackSize = BVHMetrics::compute(bvh).requiredStackSize;
+    nodes.resize(source.size());
+    for (size_t i = 0; i < source.size(); ++i) {
+        const Node& node = source[i];
+        PacketNode& packetNode = nodes[i];
+        for (int a = 0; a < 3; ++a) {
+            packetNode.bounds[a] = node.aabb.getMin()[a];
+            packetNode.bounds[a + 3] = node.aabb.getMax()[a];
+        }
+        packetNode.leftChild = node.leftChild;
+        packetNode.rightChild = node.rightChild;
+        packetNode.orderAxis = 0;
+        packetNode.orderFlip = 0;
+        if (node.isLeaf())
+            continue;
+
+        // children are ordered along the axis their centers differ most
+        const AABB& left = source[node.leftChild].aabb;
+        const AABB& right = source[node.rightChild].aabb;
+        const glm::vec3 offset = (right.getMin() + right.getMax()) - (left.getMin() + left.getMax());
+        for (int a = 1; a < 3; ++a) {
+            if (std::abs(offset[a]) > std::abs(offset[packetNode.orderAxis]))
+                packetNode.orderAxis = a;
+        }
+        packetNode.orderFlip = offset[packetNode.orderAxis] < 0.0f;
+    }
+
+    const std::vector<int>& triangleIndices = bvh.getTriangleIndices();
+    triangles.resize(triangleIndices.size());
+    for (size_t i = 0; i < triangleIndices.size(); ++i) {
+        const glm::ivec3& t = model.triangles[triangleIndices[i]];
+        const glm::vec3& p0 = model.vertices[t[0]].position;
+        const glm::vec3 e1 = model.vertices[t[1]].position - p0;
+        const glm::vec3 e2 = model.vertices[t[2]].position - p0;
+        PacketTriangle& triangle = triangles[i];
+        for (int a = 0; a < 3; ++a) {
+            triangle.v0[a] = p0[a];
+            triangle.e1[a] = e1[a];
+            triangle.e2[a] = e2[a];
+        }
+        triangle.index = triangleIndices[i];
+    }
+}
+
+PacketInstructionSet PacketBVH::detectInstructionSet()
+{
+#if defined(PACKET_KERNELS_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return PacketInstructionSet::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return PacketInstructionSet::AVX2;
+    return PacketInstructionSet::SSE2;
+#elif defined(PACKET_KERNELS_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool osSavesYmm = (info[2] >> 27 & 1) && (info[2] >> 28 & 1) && (_xgetbv(0) & 0x6) == 0x6;
+    const bool osSavesZmm = osSavesYmm && (_xgetbv(0) & 0xE0) == 0xE0;
+    int extended = 0;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        extended = info[1];
+    }
+    if (osSavesZmm && (extended >> 16 & 1))
+        return PacketInstructionSet::AVX512;
+    if (osSavesYmm && (extended >> 5 & 1))
+        return PacketInstructionSet::AVX2;
+    return PacketInstructionSet::SSE2;
+#else
+    return PacketInstructionSet::Scalar;
+#endif
+}
+
+int PacketBVH::laneCount(PacketInstructionSet instructionSet)
+{
+    switch (instructionSet) {
+    case PacketInstructionSet::AVX512:
+        return 16;
+    case PacketInstructionSet::AVX2:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+int PacketBVH::selectWidth(int width)
+{
+    const PacketInstructionSet widest = detectInstructionSet();
+    if (widest == PacketInstructionSet::Scalar)
+        instructionSet = widest;
+    else if (width >= 16 && widest == PacketInstructionSet::AVX512)
+        instructionSet = PacketInstructionSet::AVX512;
+    else if (width >= 8 && widest != PacketInstructionSet::SSE2)
+        instructionSet = PacketInstructionSet::AVX2;
+    else
+        instructionSet = PacketInstructionSet::SSE2;
+    return getPacketWidth();
+}
+
+void PacketBVH::intersect(RayPacket& packet, TraversalStats* stats) const
+{
+    trace(packet, stats, false);
+}
+
+void PacketBVH::occluded(RayPacket& packet, TraversalStats* stats) const
+{
+    trace(packet, stats, true);
+}
+
+void PacketBVH::trace(RayPacket& packet, TraversalStats* stats, bool anyHit) const
+{
+    const int width = getPacketWidth();
+    assert(packet.count > 0 && packet.count <= width && "Packet does not fit the kernel");
+    if (nodes.empty())
+        return;
+
+    // inactive lanes are masked out, they get a copy of the first ray to keep the math finite
+    for (int lane = packet.count; lane < width; ++lane)
+        packet.set(lane, packet.ray(0));
+
+    using Kernel = long long (*)(const PacketNode*, const PacketTriangle*, RayPacket&, int*);
+    Kernel kernel = anyHit ? intersectPacketLanes<LanesScalar, true> : intersectPacketLanes<LanesScalar>;
+    switch (instructionSet) {
+#ifdef PACKET_KERNELS_X86
+    case PacketInstructionSet::AVX512:
+        kernel = anyHit ? occludedPacketAVX512 : intersectPacketAVX512;
+        break;
+    case PacketInstructionSet::AVX2:
+        kernel = anyHit ? occludedPacketAVX2 : intersectPacketAVX2;
+        break;
+    case PacketInstructionSet::SSE2:
+        kernel = anyHit ? occludedPacketSSE2 : intersectPacketSSE2;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    // the kernel pushes both children of every inner node, deep trees get their stack from the heap
+    int localStack[localStackSize];
+    std::vector<int> heapStack;
+    int* stack = localStack;
+    if (stackSize > localStackSize) {
+        heapStack.resize(stackSize);
+        stack = heapStack.data();
+    }
+
+    const long long nodeVisits = kernel(nodes.data(), triangles.data(), packet, stack);
+    if (stats)
+        stats->nodeVisits += nodeVisits;
+}
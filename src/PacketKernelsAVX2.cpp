@@ -0,0 +1,43 @@
+// 8 lane kernel, built with AVX2 code generation (see CMakeLists.txt), called only when the CPU has AVX2
+#include "PacketKernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+
+namespace {
+struct LanesAVX2 {
+    using F = __m256;
+    using M = __m256;
+    static constexpr int width = 8;
+
+    static F load(const float* p) { return _mm256_load_ps(p); }
+    static void store(float* p, F a) { _mm256_store_ps(p, a); }
+    static F broadcast(float a) { return _mm256_set1_ps(a); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M maskAnd(M a, M b) { return _mm256_and_ps(a, b); }
+    static M maskOr(M a, M b) { return _mm256_or_ps(a, b); }
+    static M maskNot(M a) { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+    static unsigned bits(M a) { return unsigned(_mm256_movemask_ps(a)); }
+    static F select(M mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+    static M firstLanes(int count) { return lt(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps(float(count))); }
+};
+}
+
+long long intersectPacketAVX2(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack)
+{
+    return intersectPacketLanes<LanesAVX2>(nodes, triangles, packet, stack);
+}
+
+long long occludedPacketAVX2(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack)
+{
+    return intersectPacketLanes<LanesAVX2, true>(nodes, triangles, packet, stack);
+}
+#endif
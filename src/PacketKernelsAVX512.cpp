@@ -0,0 +1,43 @@
+// 16 lane kernel, built with AVX-512F code generation (see CMakeLists.txt), called only when the CPU has AVX-512F
+#include "PacketKernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+
+namespace {
+struct LanesAVX512 {
+    using F = __m512;
+    using M = __mmask16;
+    static constexpr int width = 16;
+
+    static F load(const float* p) { return _mm512_load_ps(p); }
+    static void store(float* p, F a) { _mm512_store_ps(p, a); }
+    static F broadcast(float a) { return _mm512_set1_ps(a); }
+    static F add(F a, F b) { return _mm512_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm512_div_ps(a, b); }
+    static F min(F a, F b) { return _mm512_min_ps(a, b); }
+    static F max(F a, F b) { return _mm512_max_ps(a, b); }
+    static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M le(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+    static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static M maskAnd(M a, M b) { return M(a & b); }
+    static M maskOr(M a, M b) { return M(a | b); }
+    static M maskNot(M a) { return M(~a); }
+    static unsigned bits(M a) { return unsigned(a); }
+    static F select(M mask, F a, F b) { return _mm512_mask_blend_ps(mask, b, a); }
+    static M firstLanes(int count) { return M(count >= 16 ? 0xFFFF : (1u << count) - 1); }
+};
+}
+
+long long intersectPacketAVX512(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack)
+{
+    return intersectPacketLanes<LanesAVX512>(nodes, triangles, packet, stack);
+}
+
+long long occludedPacketAVX512(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack)
+{
+    return intersectPacketLanes<LanesAVX512, true>(nodes, triangles, packet, stack);
+}
+#endif
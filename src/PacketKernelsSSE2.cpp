@@ -0,0 +1,43 @@
+// 4 lane kernel, SSE2 is part of every x86-64 CPU
+#include "PacketKernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+
+namespace {
+struct LanesSSE2 {
+    using F = __m128;
+    using M = __m128;
+    static constexpr int width = 4;
+
+    static F load(const float* p) { return _mm_load_ps(p); }
+    static void store(float* p, F a) { _mm_store_ps(p, a); }
+    static F broadcast(float a) { return _mm_set1_ps(a); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static M le(F a, F b) { return _mm_cmple_ps(a, b); }
+    static M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static M maskAnd(M a, M b) { return _mm_and_ps(a, b); }
+    static M maskOr(M a, M b) { return _mm_or_ps(a, b); }
+    static M maskNot(M a) { return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+    static unsigned bits(M a) { return unsigned(_mm_movemask_ps(a)); }
+    static F select(M mask, F a, F b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static M firstLanes(int count) { return _mm_cmplt_ps(_mm_setr_ps(0, 1, 2, 3), _mm_set1_ps(float(count))); }
+};
+}
+
+long long intersectPacketSSE2(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack)
+{
+    return intersectPacketLanes<LanesSSE2>(nodes, triangles, packet, stack);
+}
+
+long long occludedPacketSSE2(const PacketNode* nodes, const PacketTriangle* triangles, RayPacket& packet, int* stack)
+{
+    return intersectPacketLanes<LanesSSE2, true>(nodes, triangles, packet, stack);
+}
+#endif
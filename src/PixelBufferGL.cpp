@@ -0,0 +1,52 @@
+#include "PixelBufferGL.h"
+#include "glad.h" // Opengl function loader
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+PixelBufferGL::PixelBufferGL(size_t capacity)
+    : capacity(capacity)
+{
+    glGenBuffers(1, &bufferID);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferID);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+PixelBufferGL::PixelBufferGL(PixelBufferGL&& other)
+    : bufferID(other.bufferID)
+    , capacity(other.capacity)
+{
+    other.bufferID = 0; // glDeleteBuffers ignores 0
+}
+
+void PixelBufferGL::write(const void* data, size_t size)
+{
+    assert(size <= capacity && "Pixel buffer is too small");
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferID);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped) {
+        std::memcpy(mapped, data, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    } else {
+        std::cerr << "Failed to map pixel buffer " << glGetError() << std::endl;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void PixelBufferGL::bind()
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferID);
+}
+
+void PixelBufferGL::unbind()
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+PixelBufferGL::~PixelBufferGL()
+{
+    glDeleteBuffers(1, &bufferID);
+}
@@ -0,0 +1,181 @@
+#include "QuantizedBVH.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define QUANTIZED_BVH_SSE
+#endif
+
+namespace {
+using BVHTraversal::SlabRay;
+
+constexpr int maxExponent = 254; // biased, 2^127
+
+float exponentScale(uint8_t exponent)
+{
+    uint32_t bits = uint32_t(exponent) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+// the only decode expression, quantization checks it, so rounding stays conservative
+float decode(float origin, int code, float scale)
+{
+    return origin + float(code) * scale;
+}
+
+// smallest power of two step that reaches high from low in maxCode steps
+uint8_t chooseExponent(float low, float high, int maxCode)
+{
+    int exponent = 1; // 2^-126, flat boxes
+    if (high > low) {
+        int power;
+        std::frexp((high - low) / maxCode, &power); // step <= 2^power
+        exponent = glm::clamp(power + 127, 1, maxExponent);
+    }
+    while (exponent < maxExponent && decode(low, maxCode, exponentScale(exponent)) < high)
+        ++exponent;
+    return exponent;
+}
+
+int quantizeMin(float value, float origin, float scale, int maxCode)
+{
+    int code = (int)glm::clamp(std::floor((value - origin) / scale), 0.0f, float(maxCode));
+    while (code > 0 && decode(origin, code, scale) > value)
+        --code;
+    return code;
+}
+
+int quantizeMax(float value, float origin, float scale, int maxCode)
+{
+    int code = (int)glm::clamp(std::ceil((value - origin) / scale), 0.0f, float(maxCode));
+    while (code < maxCode && decode(origin, code, scale) < value)
+        ++code;
+    return code;
+}
+
+#ifdef QUANTIZED_BVH_SSE
+__m128 loadQuantized(const uint8_t* codes)
+{
+    int32_t packed;
+    std::memcpy(&packed, codes, sizeof(packed));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i values = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+}
+
+__m128 loadQuantized(const uint16_t* codes)
+{
+    __m128i values = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(codes));
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, _mm_setzero_si128()));
+}
+#endif
+
+// bit i of the result is set when child i is hit inside [tMin, tMax], tNear[i] - entry distance;
+// t of a plane is q * scale * invDirection + (origin - rayOrigin) * invDirection
+template <typename Quant>
+int intersectChildren(const QuantizedNode<Quant>& node, SlabRay const& ray, float tMin, float tMax, float* tNear)
+{
+    float codeScale[3];
+    float codeOffset[3];
+    const Quant* nearPlanes[3];
+    const Quant* farPlanes[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        codeScale[axis] = exponentScale(node.exponent[axis]) * ray.invDirection[axis];
+        codeOffset[axis] = (node.origin[axis] - ray.origin[axis]) * ray.invDirection[axis];
+        nearPlanes[axis] = ray.negative[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+        farPlanes[axis] = ray.negative[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+    }
+
+#ifdef QUANTIZED_BVH_SSE
+    __m128 nearT = _mm_set1_ps(tMin);
+    __m128 farT = _mm_set1_ps(tMax);
+    for (int axis = 0; axis < 3; ++axis) {
+        const __m128 scale = _mm_set1_ps(codeScale[axis]);
+        const __m128 offset = _mm_set1_ps(codeOffset[axis]);
+        nearT = _mm_max_ps(nearT, _mm_add_ps(_mm_mul_ps(loadQuantized(nearPlanes[axis]), scale), offset));
+        farT = _mm_min_ps(farT, _mm_add_ps(_mm_mul_ps(loadQuantized(farPlanes[axis]), scale), offset));
+    }
+    _mm_storeu_ps(tNear, nearT);
+    return _mm_movemask_ps(_mm_cmple_ps(nearT, farT));
+#else
+    constexpr int width = QuantizedNode<Quant>::width;
+    int mask = 0;
+    for (int slot = 0; slot < width; ++slot) {
+        float nearT = tMin;
+        float farT = tMax;
+        for (int axis = 0; axis < 3; ++axis) {
+            nearT = std::max(nearT, nearPlanes[axis][slot] * codeScale[axis] + codeOffset[axis]);
+            farT = std::min(farT, farPlanes[axis][slot] * codeScale[axis] + codeOffset[axis]);
+        }
+        tNear[slot] = nearT;
+        mask |= int(nearT <= farT) << slot;
+    }
+    return mask;
+#endif
+}
+}
+
+template <typename Quant>
+void QuantizedBVH<Quant>::build(const WideBVH4& bvh)
+{
+    constexpr int maxCode = (1 << bits) - 1;
+    constexpr int width = QuantizedNode<Quant>::width;
+
+    const std::vector<WideNode<4>>& wideNodes = bvh.getNodes();
+    nodes.resize(wideNodes.size());
+    triangleIndices = bvh.getTriangleIndices();
+    maxStackSize = bvh.getMaxStackSize();
+
+    for (size_t i = 0; i < wideNodes.size(); ++i) {
+        const WideNode<4>& wide = wideNodes[i];
+        QuantizedNode<Quant>& node = nodes[i];
+
+        AABB box = AABB::empty();
+        for (int slot = 0; slot < width; ++slot) {
+            if (!wide.isEmpty(slot)) {
+                box.surrounding(glm::vec3(wide.boundsMin[0][slot], wide.boundsMin[1][slot], wide.boundsMin[2][slot]));
+                box.surrounding(glm::vec3(wide.boundsMax[0][slot], wide.boundsMax[1][slot], wide.boundsMax[2][slot]));
+            }
+        }
+
+        for (int axis = 0; axis < 3; ++axis) {
+            const float origin = box.getMin()[axis];
+            node.origin[axis] = origin;
+            node.exponent[axis] = chooseExponent(origin, box.getMax()[axis], maxCode);
+            const float scale = exponentScale(node.exponent[axis]);
+
+            for (int slot = 0; slot < width; ++slot) {
+                if (wide.isEmpty(slot)) {
+                    node.boundsMin[axis][slot] = maxCode;
+                    node.boundsMax[axis][slot] = 0;
+                } else {
+                    node.boundsMin[axis][slot] = quantizeMin(wide.boundsMin[axis][slot], origin, scale, maxCode);
+                    node.boundsMax[axis][slot] = quantizeMax(wide.boundsMax[axis][slot], origin, scale, maxCode);
+                }
+            }
+        }
+
+        for (int slot = 0; slot < width; ++slot) {
+            assert(wide.triangleCount[slot] <= 255 && "Quantized nodes store leaf size in 8 bits");
+            node.child[slot] = wide.child[slot];
+            node.triangleCount[slot] = wide.triangleCount[slot];
+        }
+    }
+}
+
+template <typename Quant>
+bool QuantizedBVH<Quant>::intersect(const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats) const
+{
+    const SlabRay slabRay(ray);
+    return BVHTraversal::intersectWide<QuantizedNode<Quant>::width>(nodes, triangleIndices, model, ray, hit, stats,
+        [&slabRay](const QuantizedNode<Quant>& node, float tMin, float tMax, float* tNear) {
+            return intersectChildren(node, slabRay, tMin, tMax, tNear);
+        });
+}
+
+template class QuantizedBVH<uint8_t>;
+template class QuantizedBVH<uint16_t>;
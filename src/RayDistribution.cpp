@@ -0,0 +1,64 @@
+#include "RayDistribution.h"
+#include <algorithm>
+
+RayDistribution::RayDistribution(const BVHBuilder& bvh, const Model3D& model)
+    : bvh(bvh)
+    , model(model)
+    , nodeVisits(bvh.getNodes().size(), 0)
+    , random(1)
+{
+}
+
+bool RayDistribution::record(Ray ray)
+{
+    TraversalStats stats;
+    stats.nodeVisitCounts = &nodeVisits;
+    RayHit hit;
+    const bool isHit = BVHTraversal::intersect(bvh, model, ray, hit, &stats);
+    rayCount++;
+    nodeVisitCount += stats.nodeVisits;
+    return isHit;
+}
+
+void RayDistribution::recordCamera(glm::vec3 const& location, glm::mat3 const& viewToWorld, glm::vec2 const& resolution, int count)
+{
+    std::uniform_real_distribution<float> x(0.0f, resolution.x);
+    std::uniform_real_distribution<float> y(0.0f, resolution.y);
+    for (int i = 0; i < count; ++i)
+        record(BVHTraversal::cameraRay(location, viewToWorld, resolution, glm::vec2(x(random), y(random))));
+}
+
+void RayDistribution::reset()
+{
+    std::fill(nodeVisits.begin(), nodeVisits.end(), 0);
+    rayCount = 0;
+    nodeVisitCount = 0;
+}
+
+std::vector<float> RayDistribution::triangleWeights(float uniformShare) const
+{
+    const std::vector<Node>& nodes = bvh.getNodes();
+    const std::vector<int>& triangleIndices = bvh.getTriangleIndices();
+    std::vector<float> weights(model.triangles.size(), 0.0f);
+
+    // a triangle referenced by several leaves (SBVH) takes the densest one
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const Node& node = nodes[i];
+        if (!node.isLeaf())
+            continue;
+        const float area = node.aabb.surfaceArea();
+        const float density = area > 0.0f ? nodeVisits[i] / area : 0.0f;
+        for (int k = node.triangleOffset(); k < node.triangleOffset() + node.triangleCount(); ++k)
+            weights[triangleIndices[k]] = std::max(weights[triangleIndices[k]], density);
+    }
+    double densitySum = 0.0;
+    for (float weight : weights)
+        densitySum += weight;
+
+    const float meanDensity = weights.empty() ? 0.0f : float(densitySum / weights.size());
+    const float densityScale = meanDensity > 0.0f ? (1.0f - uniformShare) / meanDensity : 0.0f;
+    const float base = meanDensity > 0.0f ? uniformShare : 1.0f;
+    for (float& weight : weights)
+        weight = base + weight * densityScale;
+    return weights;
+}
@@ -0,0 +1,273 @@
+#include "RayQuery.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+
+namespace {
+Ray loadRay(RayBuffer const& rays, int i)
+{
+    Ray ray;
+    for (int a = 0; a < 3; ++a) {
+        ray.origin[a] = rays.origin[a][i];
+        ray.direction[a] = rays.direction[a][i];
+    }
+    if (rays.tMin)
+        ray.tMin = rays.tMin[i];
+    if (rays.tMax)
+        ray.tMax = rays.tMax[i];
+    return ray;
+}
+
+// position k of the trace order, order is nullptr for the caller order
+int rayIndex(const int* order, int k)
+{
+    return order ? order[k] : k;
+}
+
+void storeHit(HitBuffer const& hits, int i, RayHit const& hit)
+{
+    hits.t[i] = hit.t;
+    hits.triangle[i] = hit.triangle;
+    if (hits.u)
+        hits.u[i] = hit.u;
+    if (hits.v)
+        hits.v[i] = hit.v;
+}
+}
+
+RayQuery::RayQuery(const BVHBuilder& bvh, const Model3D& model, RayQuerySettings const& settings)
+    : bvh(bvh)
+    , model(model)
+    , settings(settings)
+    , threadPool(std::make_unique<ThreadPool>(settings.threadCount))
+{
+    if (!bvh.getNodes().empty()) {
+        sceneBounds = bvh.getNodes()[0].aabb;
+        sceneDiagonal = glm::length(sceneBounds.getMax() - sceneBounds.getMin());
+    }
+    if (settings.packetWidth > 0) {
+        packetBVH.build(bvh, model);
+        packetWidth = packetBVH.selectWidth(settings.packetWidth);
+    }
+}
+
+bool RayQuery::isCoherent(RayBuffer const& rays, int first, int count) const
+{
+    const glm::vec3 origin(rays.origin[0][first], rays.origin[1][first], rays.origin[2][first]);
+    const glm::vec3 direction(rays.direction[0][first], rays.direction[1][first], rays.direction[2][first]);
+    const float directionLength = glm::length(direction);
+    const float maxOffset = settings.coherentOriginSpread * sceneDiagonal;
+
+    for (int i = first + 1; i < first + count; ++i) {
+        const glm::vec3 otherOrigin(rays.origin[0][i], rays.origin[1][i], rays.origin[2][i]);
+        const glm::vec3 otherDirection(rays.direction[0][i], rays.direction[1][i], rays.direction[2][i]);
+        if (glm::length(otherOrigin - origin) > maxOffset)
+            return false;
+        if (glm::dot(direction, otherDirection) < settings.coherentCosine * directionLength * glm::length(otherDirection))
+            return false;
+    }
+    return true;
+}
+
+int RayQuery::taskSize() const
+{
+    return (std::max(settings.raysPerTask, 1) + 63) / 64 * 64;
+}
+
+void RayQuery::intersect(RayBuffer const& rays, HitBuffer const& hits)
+{
+    assert((rays.count == 0 || (hits.t && hits.triangle)) && "Hit distances and triangles are required");
+    if (!settings.sortRays) {
+        traceClosest(rays, hits, nullptr);
+        return;
+    }
+
+    // rays are read and hits written through the stream order, no sorted copies
+    sortStream(rays);
+    traceClosest(rays, hits, streamOrder.data());
+}
+
+void RayQuery::occluded(RayBuffer const& rays, uint64_t* mask)
+{
+    if (!settings.sortRays) {
+        traceOcclusion(rays, mask, nullptr);
+        return;
+    }
+
+    sortStream(rays);
+    const int wordCount = (rays.count + 63) / 64;
+    streamMask.resize(wordCount);
+    traceOcclusion(rays, streamMask.data(), streamOrder.data());
+
+    // bits of one caller word come from anywhere in the stream, scattered on this thread
+    std::fill(mask, mask + wordCount, 0);
+    for (int k = 0; k < rays.count; ++k) {
+        if (streamMask[k / 64] >> (k % 64) & 1) {
+            const int i = streamOrder[k];
+            mask[i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+}
+
+void RayQuery::sortStream(RayBuffer const& rays)
+{
+    const int count = rays.count;
+    const int cellBits = std::clamp(settings.streamCellBits, 1, 10);
+    const float cellMax = float((1 << cellBits) - 1);
+    streamOctantShift = 3 * cellBits;
+    float low[3], scale[3];
+    for (int a = 0; a < 3; ++a) {
+        const float extent = sceneBounds.getMax()[a] - sceneBounds.getMin()[a];
+        low[a] = sceneBounds.getMin()[a];
+        scale[a] = (extent > 0.0f) ? cellMax / extent : 0.0f;
+    }
+
+    // direction octant, then Morton code of the origin cell
+    streamKeys.resize(count);
+    streamOrder.resize(count);
+    threadPool->parallelFor(0, count, taskSize(), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            uint64_t octant = 0;
+            int cells[3];
+            for (int a = 0; a < 3; ++a) {
+                octant |= uint64_t(rays.direction[a][i] < 0.0f) << a;
+                cells[a] = int(std::clamp((rays.origin[a][i] - low[a]) * scale[a], 0.0f, cellMax));
+            }
+            uint64_t morton = 0;
+            for (int bit = cellBits - 1; bit >= 0; --bit) {
+                for (int a = 0; a < 3; ++a)
+                    morton = morton << 1 | ((cells[a] >> bit) & 1);
+            }
+            streamKeys[i] = octant << streamOctantShift | morton;
+            streamOrder[i] = i;
+        }
+    });
+
+    // LSD radix sort of (key, ray index) like BVHBuilder::sortByMortonCode(), stable passes of 8 bits
+    constexpr int radix = 256;
+    const int grain = taskSize();
+    const int passCount = (3 + 3 * cellBits + 7) / 8;
+    const int chunkCount = (count + grain - 1) / grain;
+    streamKeysTemp.resize(count);
+    streamOrderTemp.resize(count);
+    streamOffsets.resize(size_t(chunkCount) * radix);
+
+    for (int pass = 0; pass < passCount; ++pass) {
+        const int shift = pass * 8;
+        std::fill(streamOffsets.begin(), streamOffsets.end(), 0);
+
+        threadPool->parallelFor(0, count, grain, [&](int chunkBegin, int chunkEnd) {
+            int* histogram = &streamOffsets[size_t(chunkBegin / grain) * radix];
+            for (int i = chunkBegin; i < chunkEnd; ++i)
+                histogram[(streamKeys[i] >> shift) & (radix - 1)]++;
+        });
+
+        // exclusive prefix sum, digit major, chunk minor
+        int sum = 0;
+        for (int digit = 0; digit < radix; ++digit) {
+            for (int chunk = 0; chunk < chunkCount; ++chunk) {
+                int& offset = streamOffsets[size_t(chunk) * radix + digit];
+                const int histogramCount = offset;
+                offset = sum;
+                sum += histogramCount;
+            }
+        }
+
+        threadPool->parallelFor(0, count, grain, [&](int chunkBegin, int chunkEnd) {
+            int* offset = &streamOffsets[size_t(chunkBegin / grain) * radix];
+            for (int i = chunkBegin; i < chunkEnd; ++i) {
+                const int destination = offset[(streamKeys[i] >> shift) & (radix - 1)]++;
+                streamKeysTemp[destination] = streamKeys[i];
+                streamOrderTemp[destination] = streamOrder[i];
+            }
+        });
+        streamKeys.swap(streamKeysTemp);
+        streamOrder.swap(streamOrderTemp);
+    }
+}
+
+bool RayQuery::isPacket(RayBuffer const& rays, int first, int count, const int* order) const
+{
+    if (packetWidth == 0 || count < 2)
+        return false;
+
+    // the stream order already groups rays by origin cell, a packet only has to keep one direction octant
+    if (order)
+        return streamKeys[first] >> streamOctantShift == streamKeys[first + count - 1] >> streamOctantShift;
+    return isCoherent(rays, first, count);
+}
+
+void RayQuery::traceClosest(RayBuffer const& rays, HitBuffer const& hits, const int* order)
+{
+    std::atomic<long long> packetRays { 0 };
+
+    threadPool->parallelFor(0, rays.count, taskSize(), [&](int begin, int end) {
+        RayPacket packet;
+        long long taskPacketRays = 0;
+        const int groupSize = packetWidth > 0 ? packetWidth : end - begin;
+
+        for (int first = begin; first < end; first += groupSize) {
+            const int count = std::min(groupSize, end - first);
+            if (isPacket(rays, first, count, order)) {
+                packet.count = count;
+                for (int lane = 0; lane < count; ++lane)
+                    packet.set(lane, loadRay(rays, rayIndex(order, first + lane)));
+                packetBVH.intersect(packet);
+                for (int lane = 0; lane < count; ++lane)
+                    storeHit(hits, rayIndex(order, first + lane), packet.hit(lane));
+                taskPacketRays += count;
+                continue;
+            }
+
+            for (int k = first; k < first + count; ++k) {
+                Ray ray = loadRay(rays, rayIndex(order, k));
+                RayHit hit;
+                BVHTraversal::intersect(bvh, model, ray, hit);
+                storeHit(hits, rayIndex(order, k), hit);
+            }
+        }
+        packetRays += taskPacketRays;
+    });
+    packetRayCount = packetRays;
+}
+
+void RayQuery::traceOcclusion(RayBuffer const& rays, uint64_t* mask, const int* order)
+{
+    std::atomic<long long> packetRays { 0 };
+
+    // tasks cover whole mask words, no two threads write the same word, packets do not cross words
+    threadPool->parallelFor(0, rays.count, taskSize(), [&](int begin, int end) {
+        RayPacket packet;
+        long long taskPacketRays = 0;
+        const int groupSize = packetWidth > 0 ? packetWidth : 64;
+
+        for (int word = begin / 64; word * 64 < end; ++word) {
+            const int wordEnd = std::min(end, (word + 1) * 64);
+            uint64_t bits = 0;
+            for (int first = word * 64; first < wordEnd; first += groupSize) {
+                const int count = std::min(groupSize, wordEnd - first);
+                if (isPacket(rays, first, count, order)) {
+                    packet.count = count;
+                    for (int lane = 0; lane < count; ++lane)
+                        packet.set(lane, loadRay(rays, rayIndex(order, first + lane)));
+                    packetBVH.occluded(packet);
+                    for (int lane = 0; lane < count; ++lane) {
+                        if (packet.triangle[lane] >= 0)
+                            bits |= uint64_t(1) << ((first + lane) % 64);
+                    }
+                    taskPacketRays += count;
+                    continue;
+                }
+
+                for (int k = first; k < first + count; ++k) {
+                    if (BVHTraversal::occluded(bvh, model, loadRay(rays, rayIndex(order, k))))
+                        bits |= uint64_t(1) << (k % 64);
+                }
+            }
+            mask[word] = bits;
+        }
+        packetRays += taskPacketRays;
+    });
+    packetRayCount = packetRays;
+}
@@ -7,7 +7,7 @@
 #include <iostream>
 #include <tuple>
 
-ShaderProgram::ShaderProgram(std::string const& vertexShaderPath, std::string const& fragmentShaderPath)
+ShaderProgram::ShaderProgram(std::string const& vertexShaderPath, std::string const& fragmentShaderPath, std::string const& defines)
     : programID(-1)
     , texUnitSlotIndex(0)
 {
@@ -15,8 +15,8 @@ ShaderProgram::ShaderProgram(std::string const& vertexShaderPath, std::string co
     using shader = std::tuple<std::string, int, unsigned int>; // <shader source code, shader type, shader id>
 
     std::array<shader, 2> shaderCode {
-        make_tuple(loadShaderByFile(Utils::resourceDir + vertexShaderPath), GL_VERTEX_SHADER, 0),
-        make_tuple(loadShaderByFile(Utils::resourceDir + fragmentShaderPath), GL_FRAGMENT_SHADER, 0)
+        make_tuple(loadShaderByFile(Utils::resourceDir + vertexShaderPath, defines), GL_VERTEX_SHADER, 0),
+        make_tuple(loadShaderByFile(Utils::resourceDir + fragmentShaderPath, defines), GL_FRAGMENT_SHADER, 0)
     };
 
     // For check error
@@ -55,11 +55,15 @@ ShaderProgram::ShaderProgram(std::string const& vertexShaderPath, std::string co
         glDeleteShader(std::get<2>(shaderItem));
 }
 
-std::string ShaderProgram::loadShaderByFile(std::string const& shaderPath)
+std::string ShaderProgram::loadShaderByFile(std::string const& shaderPath, std::string const& defines)
 {
     std::ifstream file(shaderPath);
     assert(file.is_open() && "Error open shader file");
     std::string shaderSource((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // #version must stay the first line
+    size_t versionEnd = shaderSource.rfind("#version", 0) == 0 ? shaderSource.find('\n') + 1 : 0;
+    shaderSource.insert(versionEnd, defines);
     return shaderSource;
 }
 
@@ -0,0 +1,68 @@
+#include "SkipBVH.h"
+
+void SkipBVH::build(const BVHBuilder& bvh)
+{
+    const std::vector<Node>& binary = bvh.getNodes();
+    nodes.clear();
+    nodes.reserve(binary.size());
+    triangleIndices = bvh.getTriangleIndices();
+
+    if (!binary.empty())
+        emitPreorder(binary, 0);
+}
+
+void SkipBVH::emitPreorder(const std::vector<Node>& binary, int binaryIndex)
+{
+    const Node& source = binary[binaryIndex];
+    const int index = nodes.size();
+
+    SkipNode node;
+    node.aabb = source.aabb;
+    node.triangleOffset = source.isLeaf() ? source.triangleOffset() : 0;
+    node.triangleCount = source.isLeaf() ? source.triangleCount() : 0;
+    nodes.push_back(node);
+
+    if (!source.isLeaf()) {
+        emitPreorder(binary, source.leftChild);
+        emitPreorder(binary, source.rightChild);
+    }
+
+    // the subtree is complete, the next emitted node follows it
+    nodes[index].skip = nodes.size();
+}
+
+bool SkipBVH::intersect(const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats) const
+{
+    const glm::vec3 invDirection = BVHTraversal::safeInverse(ray.direction);
+    const int end = nodes.size();
+    TraversalStats counters;
+
+    bool isHit = false;
+    int index = 0;
+    while (index < end) {
+        const SkipNode& node = nodes[index];
+        counters.nodeVisits++;
+
+        float tNear;
+        if (!BVHTraversal::intersectBox(node.aabb, ray.origin, invDirection, ray.tMin, ray.tMax, tNear)) {
+            index = node.skip;
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            for (int i = node.triangleOffset; i < node.triangleOffset + node.triangleCount; ++i) {
+                counters.triangleTests++;
+                isHit |= BVHTraversal::intersectTriangle(model, triangleIndices[i], ray, hit);
+            }
+            index = node.skip;
+        } else {
+            index++;
+        }
+    }
+
+    if (stats) {
+        stats->nodeVisits += counters.nodeVisits;
+        stats->triangleTests += counters.triangleTests;
+    }
+    return isHit;
+}
@@ -0,0 +1,105 @@
+#include "TexelCacheModel.h"
+#include "ClusteredBVH.h"
+#include <algorithm>
+#include <cassert>
+
+namespace {
+// same as GeometryTexture
+constexpr int pixelsPerNode = 2;
+constexpr int pixelsPerVertex = 2;
+}
+
+TexelCacheModel::TexelCacheModel(Placement const& placement, int lineWidth, int lineHeight)
+    : placement(placement)
+    , lineWidth(lineWidth)
+    , lineHeight(lineHeight)
+{
+    assert(placement.textureWidth > 0 && "Texture width is required");
+}
+
+glm::ivec2 TexelCacheModel::texel(int pixel) const
+{
+    if (pixel < placement.nodePixelCount && placement.tileWidth > 0)
+        return ClusteredBVH::tiledTexel(pixel, placement.textureWidth, placement.tileWidth, placement.tileHeight);
+    return glm::ivec2(pixel % placement.textureWidth, pixel / placement.textureWidth);
+}
+
+void TexelCacheModel::fetch(int pixel, std::vector<int64_t>& lines)
+{
+    const glm::ivec2 position = texel(pixel);
+    const int64_t linesPerRow = (placement.textureWidth + lineWidth - 1) / lineWidth;
+    lines.push_back(int64_t(position.y / lineHeight) * linesPerRow + position.x / lineWidth);
+    fetchCount++;
+}
+
+const Node& TexelCacheModel::fetchNode(const std::vector<Node>& nodes, int index)
+{
+    fetch(index * pixelsPerNode, nodeLines);
+    fetch(index * pixelsPerNode + 1, nodeLines);
+    return nodes[index];
+}
+
+long long TexelCacheModel::countLines(std::vector<int64_t>& lines)
+{
+    std::sort(lines.begin(), lines.end());
+    return std::unique(lines.begin(), lines.end()) - lines.begin();
+}
+
+bool TexelCacheModel::trace(const std::vector<Node>& nodes, const std::vector<int>& triangleIndices, const Model3D& model,
+    Ray& ray, RayHit& hit, TexelCacheStats& stats)
+{
+    if (nodes.empty())
+        return false;
+
+    const glm::vec3 invDirection = BVHTraversal::safeInverse(ray.direction);
+    const int vertexPixelOffset = placement.nodePixelCount + placement.indexPixelCount;
+    nodeLines.clear();
+    geometryLines.clear();
+    fetchCount = 0;
+
+    BVHTraversal::TraversalStack<int> stack;
+    stack.push(0);
+
+    bool isHit = false;
+    float tNear;
+    while (!stack.empty()) {
+        const Node& node = fetchNode(nodes, stack.pop());
+        if (!BVHTraversal::intersectBox(node.aabb, ray.origin, invDirection, ray.tMin, ray.tMax, tNear))
+            continue;
+
+        if (node.isLeaf()) {
+            for (int i = node.triangleOffset(); i < node.triangleOffset() + node.triangleCount(); ++i) {
+                fetch(placement.nodePixelCount + i, geometryLines);
+                const glm::ivec3& triangle = model.triangles[triangleIndices[i]];
+                for (int corner = 0; corner < 3; ++corner) {
+                    fetch(vertexPixelOffset + triangle[corner] * pixelsPerVertex, geometryLines);
+                    fetch(vertexPixelOffset + triangle[corner] * pixelsPerVertex + 1, geometryLines);
+                }
+                isHit |= BVHTraversal::intersectTriangle(model, triangleIndices[i], ray, hit);
+            }
+            continue;
+        }
+
+        float leftNear, rightNear;
+        const Node& right = fetchNode(nodes, node.rightChild);
+        const Node& left = fetchNode(nodes, node.leftChild);
+        bool rightHit = BVHTraversal::intersectBox(right.aabb, ray.origin, invDirection, ray.tMin, ray.tMax, rightNear);
+        bool leftHit = BVHTraversal::intersectBox(left.aabb, ray.origin, invDirection, ray.tMin, ray.tMax, leftNear);
+
+        // the nearer child goes last, so it is popped first
+        if (leftHit && rightHit) {
+            const bool leftFirst = leftNear < rightNear;
+            stack.push(leftFirst ? node.rightChild : node.leftChild);
+            stack.push(leftFirst ? node.leftChild : node.rightChild);
+        } else if (leftHit) {
+            stack.push(node.leftChild);
+        } else if (rightHit) {
+            stack.push(node.rightChild);
+        }
+    }
+
+    stats.nodeLines += countLines(nodeLines);
+    stats.geometryLines += countLines(geometryLines);
+    stats.fetches += fetchCount;
+    return isHit;
+}
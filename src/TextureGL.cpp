@@ -6,6 +6,7 @@
 TextureGL::TextureGL(int width, int height, TextureGLType datatype, const void* data)
     : width(width)
     , height(height)
+    , datatype(datatype)
 {
     glGenTextures(1, &textureID);
 
@@ -34,10 +35,12 @@ TextureGL::TextureGL(int width, int height, TextureGLType datatype, const void*
 }
 
 TextureGL::TextureGL(TextureGL&& other)
+    : width(other.width)
+    , height(other.height)
+    , datatype(other.datatype)
+    , textureID(other.textureID)
 {
-    other.textureID = this->textureID;
-    other.width = this->width;
-    other.height = this->height;
+    other.textureID = 0; // glDeleteTextures ignores 0
 }
 
 int TextureGL::getWidth()
@@ -55,6 +58,35 @@ void TextureGL::bind()
     glBindTexture(GL_TEXTURE_2D, textureID);
 }
 
+void TextureGL::update(int x, int y, int width, int height, const void* data)
+{
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    switch (datatype) {
+    case TextureGLType::RGB_32F: {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGB, GL_FLOAT, data);
+    } break;
+    case TextureGLType::RGBA_32F: {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_FLOAT, data);
+    } break;
+    default:
+        break;
+    }
+
+    int error = glGetError();
+    if (error)
+        std::cerr << error << std::endl;
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureGL::update(int x, int y, int width, int height, PixelBufferGL& source)
+{
+    // with a bound unpack buffer the data pointer is an offset into it
+    source.bind();
+    update(x, y, width, height, nullptr);
+    PixelBufferGL::unbind();
+}
+
 TextureGL::~TextureGL()
 {
     glDeleteTextures(1, &textureID);
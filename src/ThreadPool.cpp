@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+
+namespace {
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local int currentQueue = -1;
+}
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // the waiting thread works too, so one thread less
+    const int workerCount = threadCount - 1;
+    for (int i = 0; i < workerCount + 1; ++i)
+        queues.push_back(std::make_unique<Queue>());
+
+    for (int i = 0; i < workerCount; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stop = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::TaskGroup::run(std::function<void()> task)
+{
+    pending++;
+    pool.push({ std::move(task), this });
+}
+
+void ThreadPool::TaskGroup::wait()
+{
+    waitPending();
+
+    std::exception_ptr exception;
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        std::swap(exception, error);
+    }
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+void ThreadPool::TaskGroup::waitPending()
+{
+    const int queueIndex = pool.currentQueueIndex();
+    while (pending > 0) {
+        if (!pool.tryRunOne(queueIndex))
+            std::this_thread::yield();
+    }
+}
+
+void ThreadPool::TaskGroup::fail(std::exception_ptr exception)
+{
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (!error)
+        error = exception;
+}
+
+int ThreadPool::currentQueueIndex() const
+{
+    return (currentPool == this) ? currentQueue : (int)queues.size() - 1;
+}
+
+void ThreadPool::push(Task&& task)
+{
+    Queue& queue = *queues[currentQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    queuedCount++;
+
+    // empty lock, so a worker can not miss the notify between predicate check and wait
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+}
+
+bool ThreadPool::tryRunOne(int queueIndex)
+{
+    const int queueCount = (int)queues.size();
+    Task task;
+    bool found = false;
+
+    // own queue from the back (most recent, hot in cache), others from the front
+    for (int i = 0; i < queueCount && !found; ++i) {
+        Queue& queue = *queues[(queueIndex + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        found = true;
+    }
+
+    if (!found)
+        return false;
+
+    queuedCount--;
+
+    // a throwing task must still count as done, or wait() would spin forever,
+    // its exception goes to the group and wait() rethrows it on the waiting thread
+    try {
+        task.function();
+    } catch (...) {
+        task.group->fail(std::current_exception());
+    }
+    task.group->pending.fetch_sub(1);
+    return true;
+}
+
+void ThreadPool::workerLoop(int queueIndex)
+{
+    currentPool = this;
+    currentQueue = queueIndex;
+
+    while (true) {
+        if (tryRunOne(queueIndex))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stop || queuedCount > 0; });
+        if (stop && queuedCount == 0)
+            return;
+    }
+}
@@ -0,0 +1,89 @@
+#include "TwoLevelBVH.h"
+#include <cassert>
+
+TwoLevelBVH::TwoLevelBVH()
+    : TwoLevelBVH(BVHBuildSettings())
+{
+}
+
+TwoLevelBVH::TwoLevelBVH(BVHBuildSettings const& topLevelSettings)
+    : topLevel(topLevelSettings)
+{
+}
+
+int TwoLevelBVH::addMesh(const Model3D& model, const BVHBuilder& bvh)
+{
+    assert(!bvh.getNodes().empty() && "Mesh tree must be built");
+    meshes.push_back({ &model, &bvh });
+    return meshes.size() - 1;
+}
+
+int TwoLevelBVH::addInstance(int mesh, glm::mat4 const& transform)
+{
+    assert(mesh >= 0 && mesh < (int)meshes.size() && "Unknown mesh");
+    instances.push_back({ mesh, transform, glm::inverse(transform) });
+    return instances.size() - 1;
+}
+
+void TwoLevelBVH::build()
+{
+    std::vector<AABB> instanceBounds(instances.size());
+    for (size_t i = 0; i < instances.size(); ++i) {
+        const MeshInstance& instance = instances[i];
+        const AABB& local = meshes[instance.mesh].bvh->getNodes()[0].aabb;
+
+        // world box of the 8 transformed corners
+        AABB world = AABB::empty();
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 point((corner & 1) ? local.getMax().x : local.getMin().x,
+                (corner & 2) ? local.getMax().y : local.getMin().y,
+                (corner & 4) ? local.getMax().z : local.getMin().z);
+            world.surrounding(glm::vec3(instance.transform * glm::vec4(point, 1.0f)));
+        }
+        instanceBounds[i] = world;
+    }
+    topLevel.build(instanceBounds);
+}
+
+bool TwoLevelBVH::intersect(Ray& ray, RayHit& hit, TraversalStats* stats) const
+{
+    const std::vector<int>& instanceIndices = topLevel.getTriangleIndices();
+    // bottom-level counters go to the loop's own counters, they have no node visit counts:
+    // those of stats are indexed by top-level nodes
+    return BVHTraversal::intersectNodes(topLevel.getNodes(), ray, stats, [&](const Node& leaf, TraversalStats& counters) {
+        bool isHit = false;
+        for (int i = leaf.triangleOffset(); i < leaf.triangleOffset() + leaf.triangleCount(); ++i) {
+            const MeshInstance& instance = instances[instanceIndices[i]];
+            const Mesh& mesh = meshes[instance.mesh];
+
+            Ray local = ray;
+            local.origin = glm::vec3(instance.inverse * glm::vec4(ray.origin, 1.0f));
+            local.direction = glm::mat3(instance.inverse) * ray.direction;
+            if (BVHTraversal::intersect(*mesh.bvh, *mesh.model, local, hit, stats ? &counters : nullptr)) {
+                ray.tMax = local.tMax;
+                hit.instance = instanceIndices[i];
+                isHit = true;
+            }
+        }
+        return isHit;
+    });
+}
+
+bool TwoLevelBVH::occluded(Ray const& ray, TraversalStats* stats) const
+{
+    const std::vector<int>& instanceIndices = topLevel.getTriangleIndices();
+    Ray shadowRay = ray;
+    return BVHTraversal::intersectNodes<true>(topLevel.getNodes(), shadowRay, stats, [&](const Node& leaf, TraversalStats& counters) {
+        for (int i = leaf.triangleOffset(); i < leaf.triangleOffset() + leaf.triangleCount(); ++i) {
+            const MeshInstance& instance = instances[instanceIndices[i]];
+            const Mesh& mesh = meshes[instance.mesh];
+
+            Ray local = ray;
+            local.origin = glm::vec3(instance.inverse * glm::vec4(ray.origin, 1.0f));
+            local.direction = glm::mat3(instance.inverse) * ray.direction;
+            if (BVHTraversal::occluded(*mesh.bvh, *mesh.model, local, stats ? &counters : nullptr))
+                return true;
+        }
+        return false;
+    });
+}
@@ -0,0 +1,162 @@
+#include "WideBVH.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define WIDE_BVH_SSE
+#endif
+
+namespace {
+using BVHTraversal::SlabRay;
+
+// bit i of the result is set when child i is hit inside [tMin, tMax], tNear[i] - entry distance
+template <int Width>
+int intersectChildren(const WideNode<Width>& node, SlabRay const& ray, float tMin, float tMax, float* tNear)
+{
+    const float* nearPlanes[3];
+    const float* farPlanes[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        nearPlanes[axis] = ray.negative[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+        farPlanes[axis] = ray.negative[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+    }
+
+#if defined(WIDE_BVH_SSE) && defined(__AVX__)
+    if constexpr (Width == 8) {
+        __m256 nearT = _mm256_set1_ps(tMin);
+        __m256 farT = _mm256_set1_ps(tMax);
+        for (int axis = 0; axis < 3; ++axis) {
+            const __m256 origin = _mm256_set1_ps(ray.origin[axis]);
+            const __m256 invDirection = _mm256_set1_ps(ray.invDirection[axis]);
+            nearT = _mm256_max_ps(nearT, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearPlanes[axis]), origin), invDirection));
+            farT = _mm256_min_ps(farT, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farPlanes[axis]), origin), invDirection));
+        }
+        _mm256_storeu_ps(tNear, nearT);
+        return _mm256_movemask_ps(_mm256_cmp_ps(nearT, farT, _CMP_LE_OQ));
+    }
+#endif
+
+#ifdef WIDE_BVH_SSE
+    int mask = 0;
+    for (int group = 0; group < Width; group += 4) {
+        __m128 nearT = _mm_set1_ps(tMin);
+        __m128 farT = _mm_set1_ps(tMax);
+        for (int axis = 0; axis < 3; ++axis) {
+            const __m128 origin = _mm_set1_ps(ray.origin[axis]);
+            const __m128 invDirection = _mm_set1_ps(ray.invDirection[axis]);
+            nearT = _mm_max_ps(nearT, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearPlanes[axis] + group), origin), invDirection));
+            farT = _mm_min_ps(farT, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farPlanes[axis] + group), origin), invDirection));
+        }
+        _mm_storeu_ps(tNear + group, nearT);
+        mask |= _mm_movemask_ps(_mm_cmple_ps(nearT, farT)) << group;
+    }
+    return mask;
+#else
+    int mask = 0;
+    for (int slot = 0; slot < Width; ++slot) {
+        float nearT = tMin;
+        float farT = tMax;
+        for (int axis = 0; axis < 3; ++axis) {
+            nearT = std::max(nearT, (nearPlanes[axis][slot] - ray.origin[axis]) * ray.invDirection[axis]);
+            farT = std::min(farT, (farPlanes[axis][slot] - ray.origin[axis]) * ray.invDirection[axis]);
+        }
+        tNear[slot] = nearT;
+        mask |= int(nearT <= farT) << slot;
+    }
+    return mask;
+#endif
+}
+}
+
+template <int Width>
+void WideBVH<Width>::build(const BVHBuilder& bvh)
+{
+    const std::vector<Node>& binary = bvh.getNodes();
+    nodes.clear();
+    triangleIndices = bvh.getTriangleIndices();
+    maxDepth = 0;
+
+    if (binary.empty())
+        return;
+
+    // every wide node absorbs up to Width - 1 binary inner nodes
+    nodes.reserve(binary.size() / 2 / (Width - 1) + 1);
+
+    if (binary[0].isLeaf()) {
+        nodes.emplace_back();
+        for (int slot = 0; slot < Width; ++slot)
+            setSlot(nodes[0], slot, AABB::empty(), -1, 0);
+        setSlot(nodes[0], 0, binary[0].aabb, binary[0].triangleOffset(), binary[0].triangleCount());
+        maxDepth = 1;
+        return;
+    }
+
+    collapse(binary, 0, 1);
+}
+
+template <int Width>
+int WideBVH<Width>::collapse(const std::vector<Node>& binary, int binaryIndex, int depth)
+{
+    maxDepth = std::max(maxDepth, depth);
+
+    int children[Width] = { binary[binaryIndex].leftChild, binary[binaryIndex].rightChild };
+    int childCount = 2;
+
+    // open the inner child with the largest area, it is the most likely to be traversed
+    while (childCount < Width) {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (int i = 0; i < childCount; ++i) {
+            const Node& child = binary[children[i]];
+            if (!child.isLeaf() && child.aabb.surfaceArea() > largestArea) {
+                largest = i;
+                largestArea = child.aabb.surfaceArea();
+            }
+        }
+        if (largest < 0)
+            break;
+
+        const Node& expanded = binary[children[largest]];
+        children[largest] = expanded.leftChild;
+        children[childCount++] = expanded.rightChild;
+    }
+
+    // preorder, children are created after the parent; nodes may reallocate, so access by index
+    const int wideIndex = nodes.size();
+    nodes.emplace_back();
+    for (int slot = 0; slot < Width; ++slot)
+        setSlot(nodes[wideIndex], slot, AABB::empty(), -1, 0);
+
+    for (int slot = 0; slot < childCount; ++slot) {
+        const Node& child = binary[children[slot]];
+        if (child.isLeaf()) {
+            setSlot(nodes[wideIndex], slot, child.aabb, child.triangleOffset(), child.triangleCount());
+        } else {
+            int wideChild = collapse(binary, children[slot], depth + 1);
+            setSlot(nodes[wideIndex], slot, child.aabb, wideChild, 0);
+        }
+    }
+    return wideIndex;
+}
+
+template <int Width>
+void WideBVH<Width>::setSlot(WideNode<Width>& node, int slot, AABB const& aabb, int child, int triangleCount)
+{
+    for (int axis = 0; axis < 3; ++axis) {
+        node.boundsMin[axis][slot] = aabb.getMin()[axis];
+        node.boundsMax[axis][slot] = aabb.getMax()[axis];
+    }
+    node.child[slot] = child;
+    node.triangleCount[slot] = triangleCount;
+}
+
+template <int Width>
+bool WideBVH<Width>::intersect(const Model3D& model, Ray& ray, RayHit& hit, TraversalStats* stats) const
+{
+    const SlabRay slabRay(ray);
+    return BVHTraversal::intersectWide<Width>(nodes, triangleIndices, model, ray, hit, stats,
+        [&slabRay](const WideNode<Width>& node, float tMin, float tMax, float* tNear) {
+            return intersectChildren(node, slabRay, tMin, tMax, tNear);
+        });
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
@@ -1,11 +1,23 @@
 #include "BVHBuilder.h"
+#include "BVHCache.h"
+#include "BVHOptimizer.h"
+#include "ClusteredBVH.h"
+#include "DepthFirstBVH.h"
+#include "GeometryRebuilder.h"
+#include "GeometryTexture.h"
 #include "ModelLoader.h"
+#include "QuantizedBVH.h"
+#include "RayDistribution.h"
 #include "SDLHelper.h"
 #include "ShaderProgram.h"
+#include "SkipBVH.h"
 #include "TextureGL.h"
+#include "TwoLevelBVH.h"
 #include "Utils.h"
+#include "WideBVH.h"
 #include "glad.h" // Opengl function loader
 #include <assert.h>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <fwd.hpp> //GLM
@@ -21,15 +33,6 @@ using glm::vec3;
 using glm::vec4;
 using std::vector;
 
-// reinterpret integers (tri indices, vert indices) to float texture
-// advantage - create bigger than 16777216 pixel texture
-// drawbacks - some drivers do calculation with NEAREST texture sample as well, so data can be corrupted
-// to fetch int data in shader - use floatBitsToInt(...)
-// apply the same macro in raytracing shader!
-
-#define REINTERPRET_FLOAT_DATA
-// Nvidia propietary 530 driver works fine, Intel Mesa - does some mess.
-
 #define LOG(x) std::cout << x << std::endl
 
 constexpr int WinWidth = 1920;
@@ -39,7 +42,64 @@ std::map<int, bool> buttinInputKeys; // keyboard key
 float yaw = -90.0f; // for cam rotate
 float pitch = 00.0f; // for cam rotate
 
-void loadGeometry(BVHBuilder& bvh, std::string const& path, Model3D& model)
+enum class BVHNodeFormat {
+    Binary,
+    Wide4,
+    Wide8,
+    Quantized8, // 4 wide, 8 bit child bounds
+    Quantized16,
+    SkipLinks, // binary nodes in preorder with skip pointers, stackless traversal
+    DepthFirst, // binary nodes in preorder, the left child is implicit
+    Clustered, // binary nodes grouped into treelets, one texture tile each
+};
+
+// wide and quantized trees are collapsed from the binary one only for packing
+GeometryTexture createGeometryTexture(const BVHBuilder& bvh, const Model3D& model, BVHNodeFormat format)
+{
+    WideBVH4 wide4;
+    if (format == BVHNodeFormat::Wide4 || format == BVHNodeFormat::Quantized8 || format == BVHNodeFormat::Quantized16)
+        wide4.build(bvh);
+
+    switch (format) {
+    case BVHNodeFormat::Wide4:
+        return GeometryTexture(wide4, model);
+    case BVHNodeFormat::Wide8: {
+        WideBVH8 wide8;
+        wide8.build(bvh);
+        return GeometryTexture(wide8, model);
+    }
+    case BVHNodeFormat::Quantized8: {
+        QuantizedBVH8 quantized;
+        quantized.build(wide4);
+        return GeometryTexture(quantized, model);
+    }
+    case BVHNodeFormat::Quantized16: {
+        QuantizedBVH16 quantized;
+        quantized.build(wide4);
+        return GeometryTexture(quantized, model);
+    }
+    case BVHNodeFormat::Clustered: {
+        ClusteredBVH clustered;
+        clustered.build(bvh);
+        return GeometryTexture(clustered, model);
+    }
+    case BVHNodeFormat::DepthFirst: {
+        DepthFirstBVH depthFirst;
+        depthFirst.build(bvh);
+        return GeometryTexture(depthFirst, model);
+    }
+    case BVHNodeFormat::SkipLinks: {
+        SkipBVH skip;
+        skip.build(bvh);
+        return GeometryTexture(skip, model);
+    }
+    default:
+        return GeometryTexture(bvh, model);
+    }
+}
+
+// parses the OBJ, builds the BVH and packs it, no OpenGL calls, so it can run on a worker thread
+GeometryTexture buildGeometry(BVHBuilder& bvh, std::string const& path, Model3D& model, BVHNodeFormat format, bool optimizeBVH = false)
 {
     vector<float> vertex;
     vector<float> normal;
@@ -48,123 +108,76 @@ void loadGeometry(BVHBuilder& bvh, std::string const& path, Model3D& model)
     ModelLoader::Obj(path, vertex, normal, uv);
     model = ModelLoader::toSingleMeshArray(vertex, normal, uv);
     bvh.build(model);
-}
-
-TextureGL createGeometryTexture(const BVHBuilder& bvh, const Model3D& model)
-{
-    constexpr int floatsPerPixel = 4;
-    constexpr auto format = TextureGLType::RGBA_32F;
-
-    constexpr int nFloatsInNode = 8;
-    constexpr int nFloatsInIndex = 4;
-    constexpr int nFloatsInVertex = 8;
-    constexpr int nPixelPerNode = nFloatsInNode / floatsPerPixel;
-    constexpr int nPixelPerVertex = nFloatsInVertex / floatsPerPixel;
-
-    // calculate index buffer size
-    int numOfFloatsInNodeArray = bvh.getNodes().size() * nFloatsInNode;
-    int nodePixelCount = numOfFloatsInNodeArray / floatsPerPixel;
-
-    // calculate index buffer size
-    int numOfFloatsInIndexArray = model.triangles.size() * nFloatsInIndex;
-    int indexPixelCount = numOfFloatsInIndexArray / floatsPerPixel;
-
-    // calculate vertex buffer size
-    int numOfFloatsInVertexArray = model.vertices.size() * nFloatsInVertex;
-    int vertexPixelCount = numOfFloatsInVertexArray / floatsPerPixel;
-
-    int overallPixelCount = nodePixelCount + indexPixelCount + vertexPixelCount;
-    overallPixelCount = Utils::powerOfTwo(overallPixelCount);
-
-#ifndef REINTERPRET_FLOAT_DATA
-    assert(overallPixelCount <= 16777216 && "You can not sample more than 16777216 index with float indices");
-#endif
-
-    const int textureWidth = Utils::powerOfTwo(sqrtf(overallPixelCount));
-    const int textureHeight = overallPixelCount / textureWidth;
-
-    int floatOffset = 0;
-
-    std::vector<float> buffer;
-    buffer.resize(textureHeight * textureWidth * floatsPerPixel, 0);
-
-    const int nodeIndexPixelOffset = nodePixelCount;
-
-    for (int i = 0; i < bvh.getNodes().size(); ++i) {
-        const auto& n = bvh.getNodes()[i];
 
-        int leftChildIndex = (n.leftChild <= 0)
-            ? n.leftChild - nodeIndexPixelOffset // if triangle
-            : n.leftChild * nPixelPerNode; //  if node
-
-        int rightChildIndex = (n.rightChild <= 0)
-            ? n.rightChild - nodeIndexPixelOffset
-            : n.rightChild * nPixelPerNode;
+    if (optimizeBVH) {
+        BVHOptimizeReport report = BVHOptimizer().optimize(bvh);
+        LOG("BVH treelet optimization: SAH cost " << report.costBefore << " -> " << report.costAfter
+                                                  << " in " << report.milliseconds << " ms");
+    }
 
-        // first pixel
-#ifdef REINTERPRET_FLOAT_DATA
-        buffer[i * nFloatsInNode + 0] = reinterpret_cast<float&>(leftChildIndex);
-        buffer[i * nFloatsInNode + 1] = reinterpret_cast<float&>(rightChildIndex);
-#else
-        buffer[i * nFloatsInNode + 0] = float(leftChildIndex);
-        buffer[i * nFloatsInNode + 1] = float(rightChildIndex);
-#endif
+    LOG("BVH nodes: " << bvh.getNodes().size() << ", SAH cost: " << bvh.computeSAHCost()
+                      << ", triangle duplication: " << bvh.getDuplicationFactor());
 
-        buffer[i * nFloatsInNode + 2] = n.aabb.getMin().x;
-        buffer[i * nFloatsInNode + 3] = n.aabb.getMin().y;
+    return createGeometryTexture(bvh, model, format);
+}
 
-        // second pixel
-        buffer[i * nFloatsInNode + 4] = n.aabb.getMin().z;
-        buffer[i * nFloatsInNode + 5] = n.aabb.getMax().x;
-        buffer[i * nFloatsInNode + 6] = n.aabb.getMax().y;
-        buffer[i * nFloatsInNode + 7] = n.aabb.getMax().z;
+// Geometry texture from the binary cache next to the OBJ file when it matches the file content and settings,
+// otherwise the OBJ is parsed, the BVH is built and the cache is written for the next launch
+GeometryTexture loadGeometry(BVHBuilder& bvh, std::string const& path, Model3D& model, BVHNodeFormat format, bool optimizeBVH = false)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedMs = [&start] { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+
+    const std::string sourcePath = Utils::resourceDir + path;
+    const std::string cachePath = sourcePath + ".bvhcache";
+
+    BVHCache::Key key;
+    const uint32_t variant = uint32_t(format) << 1 | uint32_t(optimizeBVH);
+    const bool canCache = BVHCache::makeKey(sourcePath, bvh.getSettings(), variant, key);
+
+    BVHCache cache;
+    if (canCache && cache.open(cachePath, key)) {
+        cache.loadModel(model);
+        cache.loadBVH(bvh);
+        GeometryTexture geometry(cache.getTextureLayout(), cache.getTexturePixels(), cache.getShaderDefines());
+        LOG("BVH nodes: " << bvh.getNodes().size() << ", loaded from cache in " << elapsedMs() << " ms");
+        return geometry;
     }
-    floatOffset += numOfFloatsInNodeArray;
 
-    const int triIndexPixelOffset = nodePixelCount + indexPixelCount;
+    GeometryTexture geometry = buildGeometry(bvh, path, model, format, optimizeBVH);
+    LOG("Geometry loaded and built in " << elapsedMs() << " ms");
 
-    for (int i = 0; i < model.triangles.size(); ++i) {
-        const auto& t = model.triangles[i];
+    if (canCache && !BVHCache::save(cachePath, key, model, bvh, geometry))
+        std::cerr << "Failed to write BVH cache " << cachePath << std::endl;
+    return geometry;
+}
 
-        int t0 = t[0] * nPixelPerVertex + triIndexPixelOffset;
-        int t1 = t[1] * nPixelPerVertex + triIndexPixelOffset;
-        int t2 = t[2] * nPixelPerVertex + triIndexPixelOffset;
+// gridSize x gridSize instances of one model on the XZ plane, the bottom-level tree is built and packed once
+GeometryTexture createInstanceGrid(BVHBuilder& bvh, std::string const& path, Model3D& model, int gridSize)
+{
+    vector<float> vertex;
+    vector<float> normal;
+    vector<float> uv;
 
-#ifdef REINTERPRET_FLOAT_DATA
-        buffer[floatOffset + i * nFloatsInIndex + 0] = reinterpret_cast<float&>(t0);
-        buffer[floatOffset + i * nFloatsInIndex + 1] = reinterpret_cast<float&>(t1);
-        buffer[floatOffset + i * nFloatsInIndex + 2] = reinterpret_cast<float&>(t2);
-#else
-        buffer[floatOffset + i * nFloatsInIndex + 0] = float(t0);
-        buffer[floatOffset + i * nFloatsInIndex + 1] = float(t1);
-        buffer[floatOffset + i * nFloatsInIndex + 2] = float(t2);
-#endif
+    ModelLoader::Obj(path, vertex, normal, uv);
+    model = ModelLoader::toSingleMeshArray(vertex, normal, uv);
+    bvh.build(model);
 
-        buffer[floatOffset + i * nFloatsInIndex + 3] = 0;
-    }
-    floatOffset += numOfFloatsInIndexArray;
-
-    for (int i = 0; i < model.vertices.size(); ++i) {
-        const auto& v = model.vertices[i];
-
-        // first pixel
-        buffer[floatOffset + i * nFloatsInVertex + 0] = v.position.x;
-        buffer[floatOffset + i * nFloatsInVertex + 1] = v.position.y;
-        buffer[floatOffset + i * nFloatsInVertex + 2] = v.position.z;
-        buffer[floatOffset + i * nFloatsInVertex + 3] = v.normal.x;
-
-        // second pixel
-        buffer[floatOffset + i * nFloatsInVertex + 4] = v.normal.y;
-        buffer[floatOffset + i * nFloatsInVertex + 5] = v.normal.z;
-        buffer[floatOffset + i * nFloatsInVertex + 6] = v.uv.x;
-        buffer[floatOffset + i * nFloatsInVertex + 7] = v.uv.y;
+    TwoLevelBVH scene;
+    const int mesh = scene.addMesh(model, bvh);
+    const AABB& bounds = bvh.getNodes()[0].aabb;
+    const float spacing = glm::length(bounds.getMax() - bounds.getMin());
+    for (int x = 0; x < gridSize; ++x) {
+        for (int z = 0; z < gridSize; ++z) {
+            mat4 transform = glm::translate(mat4(1.0f), vec3(x, 0.0f, z) * spacing);
+            transform = glm::rotate(transform, float(x * gridSize + z), vec3(0.0f, 1.0f, 0.0f));
+            scene.addInstance(mesh, transform);
+        }
     }
-    LOG("Node pixel count: " << nodePixelCount
-                             << ", Index pixel count: " << indexPixelCount
-                             << ", Vertex pixel count: " << vertexPixelCount);
-    LOG("TextureResolution: " << textureWidth << "x" << textureHeight);
+    scene.build();
 
-    return TextureGL(textureWidth, textureHeight, format, buffer.data());
+    LOG("Instances: " << scene.getInstances().size() << ", top-level nodes: " << scene.getTopLevel().getNodes().size());
+    return GeometryTexture(scene);
 }
 
 // FPS Camera rotate
@@ -239,16 +252,31 @@ int main(int ArgCount, char** Args)
     glGenVertexArrays(1, &VAO);
 
     // Load geometry, build BVH && and load data to texture
-    BVHBuilder* bvh = new BVHBuilder(); // Big object
+    BVHBuildSettings bvhSettings;
+    bvhSettings.splitMethod = BVHSplitMethod::BinnedSAH; // or BVHSplitMethod::Midpoint
+    BVHBuilder* bvh = new BVHBuilder(bvhSettings); // Big object
 
     Model3D model;
-    // loadGeometry(*bvh, "models/BullPlane.obj", model);
-    loadGeometry(*bvh, "models/stanford_dragon.obj", model);
-    // loadGeometry(*bvh, "models/susanne_lowpoly.obj", model);
-
-    TextureGL texAllGeometry = createGeometryTexture(*bvh, model);
+    const std::string modelPath = "models/stanford_dragon.obj";
+    const BVHNodeFormat nodeFormat = BVHNodeFormat::Wide4;
+    // GeometryTexture geometry = loadGeometry(*bvh, "models/BullPlane.obj", model, BVHNodeFormat::Wide4);
+    GeometryTexture geometry = loadGeometry(*bvh, modelPath, model, nodeFormat);
+    // GeometryTexture geometry = loadGeometry(*bvh, "models/susanne_lowpoly.obj", model, BVHNodeFormat::Wide4);
+    // GeometryTexture geometry = createInstanceGrid(*bvh, "models/stanford_dragon.obj", model, 16);
     // TextureGL texVertArray = createVertexArrayTexture(model);
-    ShaderProgram shaderProgram("shaders/vertex.vert", "shaders/raytracing.frag");
+    auto shaderProgram = std::make_unique<ShaderProgram>("shaders/vertex.vert", "shaders/raytracing.frag", geometry.getShaderDefines());
+
+    // R - rebuild with the next split method in background, the old geometry is traced until the new one is uploaded
+    GeometryRebuilder rebuilder;
+    BVHSplitMethod rebuildSplitMethod = bvhSettings.splitMethod;
+
+    // C - toggle recording of where the camera rays go, sampled on the CPU every frame, off by default.
+    // T - binned SAH rebuild weighted by the recorded rays.
+    // Triangle trees only, the instance grid tree references instances
+    RayDistribution rayDistribution(*bvh, model);
+    const bool canRecordRays = bvh->getTriangleIndices().size() == model.triangles.size();
+    bool recordRays = false;
+    constexpr int recordedRaysPerFrame = 256;
 
     // Variable for camera
     vec3 location = vec3(11, 0.01, -0.501);
@@ -285,10 +313,51 @@ int main(int ArgCount, char** Args)
 
             if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_ESCAPE)
                 return 0;
+
+            if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_r && !rebuilder.isBusy()) {
+                rebuildSplitMethod = BVHSplitMethod((int(rebuildSplitMethod) + 1) % (int(BVHSplitMethod::PLOC) + 1));
+                BVHBuildSettings settings = bvhSettings;
+                settings.splitMethod = rebuildSplitMethod;
+                rebuilder.request([settings, modelPath, nodeFormat] {
+                    BVHBuilder bvh(settings);
+                    Model3D model;
+                    return buildGeometry(bvh, modelPath, model, nodeFormat);
+                });
+                LOG("Rebuild requested, split method " << int(rebuildSplitMethod));
+            }
+
+            if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_c && canRecordRays) {
+                recordRays = !recordRays;
+                if (recordRays)
+                    rayDistribution.reset();
+                LOG("Ray recording " << (recordRays ? "on" : "off"));
+            }
+
+            if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_t && !rebuilder.isBusy() && rayDistribution.getRayCount() > 0) {
+                BVHBuildSettings settings = bvhSettings;
+                settings.splitMethod = BVHSplitMethod::BinnedSAH;
+                rebuilder.request([settings, weights = rayDistribution.triangleWeights(), modelPath, nodeFormat] {
+                    BVHBuilder bvh(settings);
+                    bvh.setTriangleWeights(weights);
+                    Model3D model;
+                    return buildGeometry(bvh, modelPath, model, nodeFormat);
+                });
+                LOG("Rebuild requested, weighted by " << rayDistribution.getRayCount() << " recorded rays");
+            }
+        }
+
+        // swap at the frame boundary, the program is recompiled only for another node format
+        if (std::optional<GeometryTexture> rebuilt = rebuilder.poll()) {
+            if (rebuilt->getShaderDefines() != geometry.getShaderDefines())
+                shaderProgram = std::make_unique<ShaderProgram>("shaders/vertex.vert", "shaders/raytracing.frag", rebuilt->getShaderDefines());
+            geometry = std::move(*rebuilt);
         }
+        TextureGL& texAllGeometry = geometry.getTexture();
 
         cameraMove(location, viewToWorld);
         updateMatrix(viewToWorld);
+        if (recordRays)
+            rayDistribution.recordCamera(location, viewToWorld, vec2(WinWidth, WinHeight), recordedRaysPerFrame);
 
         // Render/Draw
         // Clear the colorbuffer
@@ -297,15 +366,15 @@ int main(int ArgCount, char** Args)
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        shaderProgram.bind();
+        shaderProgram->bind();
         glBindVertexArray(VAO);
 
-        shaderProgram.setMatrix3x3("viewToWorld", viewToWorld);
-        shaderProgram.setVec3("location", location);
-        shaderProgram.setVec2("screeResolution", vec2(WinWidth, WinHeight));
+        shaderProgram->setMatrix3x3("viewToWorld", viewToWorld);
+        shaderProgram->setVec3("location", location);
+        shaderProgram->setVec2("screeResolution", vec2(WinWidth, WinHeight));
 
-        shaderProgram.setTextureAI("texGeometry", texAllGeometry);
-        shaderProgram.setInt2("texGeometrySize", texAllGeometry.getWidth(), texAllGeometry.getHeight());
+        shaderProgram->setTextureAI("texGeometry", texAllGeometry);
+        shaderProgram->setInt2("texGeometrySize", texAllGeometry.getWidth(), texAllGeometry.getHeight());
 
         // shaderProgram.setTextureAI("texVertArray", texVertArray);
         // shaderProgram.setInt2("texVertArraySize", texVertArray.getWidth(), texVertArray.getHeight());
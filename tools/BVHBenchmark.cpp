@@ -0,0 +1,514 @@
+// Headless BVH benchmark, per model:
+// - build time, SAH cost and traversal cost of every builder
+// - SAH cost of trees over triangle bound boxes
+// - incremental edits
+// - SAH weighted by recorded camera rays
+// - batched and stream mode ambient occlusion rays
+// - single thread closest hit and occlusion traversal of binary, wide, quantized, depth-first, skip link and instanced trees
+// - texel cache lines touched by traceCloseHitV2 per node order
+// usage: BVHBenchmark [model.obj ...] (paths relative to resource dir, bundled models by default)
+
+#include "BVHBuilder.h"
+#include "BVHEditor.h"
+#include "BVHOptimizer.h"
+#include "ClusteredBVH.h"
+#include "DepthFirstBVH.h"
+#include "ModelLoader.h"
+#include "QuantizedBVH.h"
+#include "RayDistribution.h"
+#include "RayQuery.h"
+#include "SkipBVH.h"
+#include "TexelCacheModel.h"
+#include "TwoLevelBVH.h"
+#include "Utils.h"
+#include "WideBVH.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define LOG(x) std::cout << x << std::endl
+
+struct BenchmarkCase {
+    const char* name;
+    BVHBuildSettings settings;
+    bool optimize = false; // treelet restructuring after build, its time is included
+};
+
+// rays from a sphere around the model aimed at its central part, fixed seed
+std::vector<Ray> generateRays(AABB const& bounds, int count)
+{
+    const glm::vec3 center = (bounds.getMin() + bounds.getMax()) * 0.5f;
+    const float radius = glm::length(bounds.getMax() - bounds.getMin());
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    auto randomVector = [&] { return glm::vec3(uniform(random), uniform(random), uniform(random)); };
+
+    std::vector<Ray> rays(count);
+    for (Ray& ray : rays) {
+        glm::vec3 direction;
+        do
+            direction = randomVector();
+        while (glm::length(direction) > 1.0f || glm::length(direction) < 0.1f);
+
+        ray.origin = center + glm::normalize(direction) * radius;
+        glm::vec3 target = center + randomVector() * radius * 0.3f;
+        ray.direction = glm::normalize(target - ray.origin);
+    }
+    return rays;
+}
+
+template <typename Intersect>
+void benchmarkTraversal(const char* name, size_t nodeBytes, std::vector<Ray> const& rays, Intersect const& intersect)
+{
+    TraversalStats stats;
+    auto start = std::chrono::steady_clock::now();
+    for (Ray ray : rays) {
+        RayHit hit;
+        intersect(ray, hit, stats);
+    }
+    auto finish = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(finish - start).count();
+
+    const double rayCount = rays.size();
+    LOG("  " << std::left << std::setw(13) << name
+             << " nodes " << std::right << std::setw(7) << std::fixed << std::setprecision(1) << nodeBytes / 1024.0 << " KB"
+             << " " << std::setw(6) << std::setprecision(2) << rayCount / seconds * 1e-6 << " Mrays/s"
+             << "  nodes/ray " << std::setw(6) << stats.nodeVisits / rayCount
+             << "  pushes/ray " << std::setw(6) << stats.stackPushes / rayCount
+             << "  triangles/ray " << std::setw(6) << stats.triangleTests / rayCount);
+}
+
+// texture size and node section as GeometryTexture makes them, tiled node sections are padded to whole tile rows
+TexelCacheModel::Placement texturePlacement(int nodeCount, int triangleIndexCount, int vertexCount, int tileWidth = 0, int tileHeight = 0)
+{
+    TexelCacheModel::Placement placement;
+    placement.nodePixelCount = nodeCount * 2;
+    placement.indexPixelCount = triangleIndexCount;
+    placement.tileWidth = tileWidth;
+    placement.tileHeight = tileHeight;
+
+    const int unpaddedNodePixelCount = placement.nodePixelCount;
+    for (;;) {
+        const int pixelCount = Utils::powerOfTwo(placement.nodePixelCount + placement.indexPixelCount + vertexCount * 2);
+        const int width = Utils::powerOfTwo(std::sqrt(float(pixelCount)));
+        if (width == placement.textureWidth || tileHeight == 0) {
+            placement.textureWidth = width;
+            return placement;
+        }
+        placement.textureWidth = width;
+        const int tileRow = width * tileHeight;
+        placement.nodePixelCount = (unpaddedNodePixelCount + tileRow - 1) / tileRow * tileRow;
+    }
+}
+
+void benchmarkTexelCache(const char* name, const std::vector<Node>& nodes, const std::vector<int>& triangleIndices,
+    const Model3D& model, TexelCacheModel::Placement const& placement, std::vector<Ray> const& rays)
+{
+    TexelCacheModel cache(placement);
+    TexelCacheStats stats;
+    for (Ray ray : rays) {
+        RayHit hit;
+        cache.trace(nodes, triangleIndices, model, ray, hit, stats);
+    }
+
+    const double rayCount = rays.size();
+    LOG("  " << std::left << std::setw(16) << name
+             << " node lines/ray " << std::right << std::setw(6) << std::fixed << std::setprecision(2) << stats.nodeLines / rayCount
+             << "  geometry lines/ray " << std::setw(6) << stats.geometryLines / rayCount
+             << "  fetches/ray " << std::setw(7) << stats.fetches / rayCount);
+}
+
+// objects of objectSize consecutive triangles removed and put back one per batch, as an editor does
+void benchmarkEdits(const Model3D& model, int batchCount, int objectSize)
+{
+    BVHBuilder bvh;
+    bvh.build(model);
+    const int triangleCount = model.triangles.size();
+    BVHEditor editor(bvh, BVHEditor::triangleBounds(model, 0, triangleCount));
+
+    std::mt19937 random(1);
+    double milliseconds = 0.0;
+    long long dirtyNodes = 0;
+    long long nodes = 0;
+    int rebuilds = 0;
+    float cost = 0.0f;
+    for (int batch = 0; batch < batchCount; ++batch) {
+        const int first = random() % std::max(1, triangleCount - objectSize);
+        const int count = std::min(objectSize, triangleCount - first);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = first; i < first + count; ++i)
+            editor.remove(i);
+        std::vector<AABB> bounds = BVHEditor::triangleBounds(model, first, count);
+        for (int i = 0; i < count; ++i)
+            editor.insert(first + i, bounds[i]);
+        BVHEditReport report = editor.finishEdits();
+        milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for (DirtyRange const& range : report.nodes)
+            dirtyNodes += range.end - range.begin;
+        nodes += bvh.getNodes().size();
+        rebuilds += report.rebuilt;
+        cost = report.costAfter;
+    }
+
+    LOG("  " << std::left << std::setw(13) << "edits"
+             << " " << std::right << std::setw(6) << std::fixed << std::setprecision(3) << milliseconds / batchCount << " ms/object"
+             << "  dirty nodes " << std::setw(5) << std::setprecision(1) << 100.0 * dirtyNodes / nodes << " %"
+             << "  rebuilds " << rebuilds << "/" << batchCount
+             << "  SAH cost " << std::setprecision(2) << cost);
+}
+
+// trees over triangle bound boxes, as the top level of a two-level scene and BVHEditor rebuilds make them,
+// SBVH has no triangles to clip there and must give the binned SAH tree
+void benchmarkPrimitiveBounds(const Model3D& model)
+{
+    const std::vector<AABB> bounds = BVHEditor::triangleBounds(model, 0, model.triangles.size());
+    auto cost = [&](BVHSplitMethod splitMethod) {
+        BVHBuildSettings settings;
+        settings.splitMethod = splitMethod;
+        BVHBuilder bvh(settings);
+        bvh.build(bounds);
+        return bvh.computeSAHCost();
+    };
+
+    LOG("  " << std::left << std::setw(13) << "bound boxes"
+             << " SAH cost midpoint " << std::right << std::fixed << std::setprecision(2) << cost(BVHSplitMethod::Midpoint)
+             << "  binned SAH " << cost(BVHSplitMethod::BinnedSAH)
+             << "  SBVH " << cost(BVHSplitMethod::SBVH));
+}
+
+// camera rays of a few fixed viewpoints in front of the model, like raytracing.frag renders them
+struct CameraPath {
+    std::vector<glm::vec3> locations;
+    std::vector<glm::mat3> viewToWorld;
+    glm::vec2 resolution = glm::vec2(320, 180);
+};
+
+CameraPath frontalCameraPath(AABB const& bounds, int viewCount)
+{
+    CameraPath path;
+    const glm::vec3 center = (bounds.getMin() + bounds.getMax()) * 0.5f;
+    const float distance = 0.7f * glm::length(bounds.getMax() - bounds.getMin()); // model fills the view
+    for (int i = 0; i < viewCount; ++i) {
+        const float angle = glm::radians(-20.0f + 40.0f * i / std::max(viewCount - 1, 1));
+        const glm::vec3 location = center + distance * glm::vec3(std::sin(angle), 0.1f, std::cos(angle));
+        const glm::vec3 forward = glm::normalize(center - location);
+        const glm::vec3 right = glm::normalize(glm::cross(glm::vec3(0, 1, 0), forward));
+        path.locations.push_back(location);
+        path.viewToWorld.push_back(glm::mat3(right, glm::cross(forward, right), forward));
+    }
+    return path;
+}
+
+// rays per view recorded on the SAH tree at random pixels, then both trees traverse a pixel grid of the same views
+void benchmarkRayDistribution(const Model3D& model, AABB const& bounds, int recordRaysPerView)
+{
+    const CameraPath path = frontalCameraPath(bounds, 4);
+
+    BVHBuilder bvh;
+    bvh.build(model);
+    RayDistribution distribution(bvh, model);
+    for (size_t v = 0; v < path.locations.size(); ++v)
+        distribution.recordCamera(path.locations[v], path.viewToWorld[v], path.resolution, recordRaysPerView);
+
+    BVHBuilder weighted;
+    weighted.setTriangleWeights(distribution.triangleWeights());
+    weighted.build(model);
+
+    auto traverse = [&](const BVHBuilder& tree) {
+        TraversalStats stats;
+        long long rayCount = 0;
+        for (size_t v = 0; v < path.locations.size(); ++v) {
+            for (float y = 0.5f; y < path.resolution.y; y += 2.0f) {
+                for (float x = 0.5f; x < path.resolution.x; x += 2.0f) {
+                    Ray ray = BVHTraversal::cameraRay(path.locations[v], path.viewToWorld[v], path.resolution, glm::vec2(x, y));
+                    RayHit hit;
+                    BVHTraversal::intersect(tree, model, ray, hit, &stats);
+                    rayCount++;
+                }
+            }
+        }
+        const double rays = std::max(rayCount, 1ll);
+        return std::make_pair(stats.nodeVisits / rays, stats.triangleTests / rays);
+    };
+    auto [sahNodes, sahTriangles] = traverse(bvh);
+    auto [weightedNodes, weightedTriangles] = traverse(weighted);
+
+    LOG("  " << std::left << std::setw(13) << "ray weighted"
+             << " nodes/ray " << std::right << std::fixed << std::setprecision(2) << sahNodes << " -> " << weightedNodes
+             << "  triangles/ray " << sahTriangles << " -> " << weightedTriangles
+             << "  SAH cost " << bvh.computeSAHCost() << " -> " << weighted.computeSAHCost()
+             << "  recorded rays " << distribution.getRayCount());
+}
+
+// Ambient occlusion rays from the primary hits of the camera views, samplesPerPixel cosine weighted rays per hit
+// in shuffled order, like the secondary rays of a wavefront renderer after a few bounces.
+// One thread, RayQuery with default settings against stream mode
+void benchmarkRayStreams(const BVHBuilder& bvh, const Model3D& model, AABB const& bounds, int samplesPerPixel)
+{
+    const CameraPath path = frontalCameraPath(bounds, 4);
+    const float diagonal = glm::length(bounds.getMax() - bounds.getMin());
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<float> origins[3], directions[3], tMax;
+    for (size_t v = 0; v < path.locations.size(); ++v) {
+        for (float y = 0.5f; y < path.resolution.y; y += 1.0f) {
+            for (float x = 0.5f; x < path.resolution.x; x += 1.0f) {
+                Ray ray = BVHTraversal::cameraRay(path.locations[v], path.viewToWorld[v], path.resolution, glm::vec2(x, y));
+                RayHit hit;
+                if (!BVHTraversal::intersect(bvh, model, ray, hit))
+                    continue;
+
+                const glm::ivec3& triangle = model.triangles[hit.triangle];
+                const glm::vec3 p0 = model.vertices[triangle[0]].position;
+                glm::vec3 normal = glm::normalize(glm::cross(model.vertices[triangle[1]].position - p0, model.vertices[triangle[2]].position - p0));
+                if (glm::dot(normal, ray.direction) > 0.0f)
+                    normal = -normal;
+                const glm::vec3 tangent = glm::normalize(glm::cross(std::abs(normal.x) > 0.5f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0), normal));
+                const glm::vec3 bitangent = glm::cross(normal, tangent);
+                const glm::vec3 origin = ray.origin + ray.direction * hit.t + normal * (1e-4f * diagonal);
+
+                for (int s = 0; s < samplesPerPixel; ++s) {
+                    const float radius = std::sqrt(uniform(random));
+                    const float angle = 6.2831853f * uniform(random);
+                    const glm::vec3 direction = tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle))
+                        + normal * std::sqrt(std::max(0.0f, 1.0f - radius * radius));
+                    for (int a = 0; a < 3; ++a) {
+                        origins[a].push_back(origin[a]);
+                        directions[a].push_back(direction[a]);
+                    }
+                    tMax.push_back(0.1f * diagonal);
+                }
+            }
+        }
+    }
+
+    const int rayCount = tMax.size();
+    std::vector<int> order(rayCount);
+    for (int i = 0; i < rayCount; ++i)
+        order[i] = i;
+    std::shuffle(order.begin(), order.end(), random);
+    auto shuffle = [&](std::vector<float>& values) {
+        std::vector<float> shuffled(rayCount);
+        for (int i = 0; i < rayCount; ++i)
+            shuffled[i] = values[order[i]];
+        values.swap(shuffled);
+    };
+    for (int a = 0; a < 3; ++a) {
+        shuffle(origins[a]);
+        shuffle(directions[a]);
+    }
+    shuffle(tMax);
+
+    RayBuffer rays;
+    for (int a = 0; a < 3; ++a) {
+        rays.origin[a] = origins[a].data();
+        rays.direction[a] = directions[a].data();
+    }
+    rays.tMax = tMax.data();
+    rays.count = rayCount;
+    std::vector<float> t(rayCount);
+    std::vector<int> triangles(rayCount);
+    std::vector<uint64_t> mask((rayCount + 63) / 64);
+    HitBuffer hits;
+    hits.t = t.data();
+    hits.triangle = triangles.data();
+
+    auto run = [&](const char* name, bool sortRays) {
+        RayQuerySettings settings;
+        settings.threadCount = 1;
+        settings.sortRays = sortRays;
+        RayQuery query(bvh, model, settings);
+
+        auto start = std::chrono::steady_clock::now();
+        query.intersect(rays, hits);
+        auto middle = std::chrono::steady_clock::now();
+        const double packetShare = query.getPacketRayCount() * 100.0 / std::max(rayCount, 1);
+        query.occluded(rays, mask.data());
+        auto finish = std::chrono::steady_clock::now();
+
+        LOG("  " << std::left << std::setw(13) << name
+                 << " rays " << std::right << std::setw(7) << rayCount
+                 << "  closest " << std::setw(6) << std::fixed << std::setprecision(2)
+                 << rayCount / std::chrono::duration<double>(middle - start).count() * 1e-6 << " Mrays/s"
+                 << "  occlusion " << std::setw(6) << rayCount / std::chrono::duration<double>(finish - middle).count() * 1e-6 << " Mrays/s"
+                 << "  in packets " << std::setw(5) << std::setprecision(1) << packetShare << " %");
+    };
+    run("AO batch", false);
+    run("AO stream", true);
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> modelPaths;
+    for (int i = 1; i < argc; ++i)
+        modelPaths.push_back(argv[i]);
+
+    if (modelPaths.empty())
+        modelPaths = { "models/susanne_lowpoly.obj", "models/BullPlane.obj", "models/stanford_dragon.obj" };
+
+    std::vector<BenchmarkCase> cases(9);
+    cases[0].name = "midpoint";
+    cases[0].settings.splitMethod = BVHSplitMethod::Midpoint;
+    cases[1].name = "binned SAH";
+    cases[1].settings.splitMethod = BVHSplitMethod::BinnedSAH;
+    cases[2].name = "LBVH 30 bit";
+    cases[2].settings.splitMethod = BVHSplitMethod::LBVH;
+    cases[2].settings.mortonBits = 30;
+    cases[3].name = "LBVH 63 bit";
+    cases[3].settings.splitMethod = BVHSplitMethod::LBVH;
+    cases[3].settings.mortonBits = 63;
+    cases[4].name = "SBVH";
+    cases[4].settings.splitMethod = BVHSplitMethod::SBVH;
+    cases[5].name = "midpoint+opt";
+    cases[5].settings.splitMethod = BVHSplitMethod::Midpoint;
+    cases[5].optimize = true;
+    cases[6].name = "LBVH 30+opt";
+    cases[6].settings.splitMethod = BVHSplitMethod::LBVH;
+    cases[6].optimize = true;
+    cases[7].name = "PLOC r8";
+    cases[7].settings.splitMethod = BVHSplitMethod::PLOC;
+    cases[7].settings.plocRadius = 8;
+    cases[8].name = "PLOC r16";
+    cases[8].settings.splitMethod = BVHSplitMethod::PLOC;
+    cases[8].settings.plocRadius = 16;
+
+    constexpr int repeatCount = 5;
+
+    for (std::string const& path : modelPaths) {
+        std::vector<float> vertex, normal, uv;
+        ModelLoader::Obj(path, vertex, normal, uv);
+        Model3D model = ModelLoader::toSingleMeshArray(vertex, normal, uv);
+        if (model.triangles.empty())
+            continue;
+
+        LOG(path << ": " << model.triangles.size() << " triangles");
+
+        // traversal cost of each build, SAH cost only estimates it
+        AABB modelBounds = AABB::empty();
+        for (Vertex const& vertex : model.vertices)
+            modelBounds.surrounding(vertex.position);
+        const std::vector<Ray> buildRays = generateRays(modelBounds, 20000);
+
+        for (BenchmarkCase const& c : cases) {
+            BVHBuilder bvh(c.settings);
+
+            // best of several runs, the first one also warms up the thread pool
+            double bestMs = 1e30;
+            for (int i = 0; i < repeatCount; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                bvh.build(model);
+                if (c.optimize)
+                    BVHOptimizer().optimize(bvh);
+                auto finish = std::chrono::steady_clock::now();
+                bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(finish - start).count());
+            }
+
+            TraversalStats stats;
+            for (Ray ray : buildRays) {
+                RayHit hit;
+                BVHTraversal::intersect(bvh, model, ray, hit, &stats);
+            }
+            const double rayCount = buildRays.size();
+
+            LOG("  " << std::left << std::setw(13) << c.name
+                     << " build " << std::right << std::setw(9) << std::fixed << std::setprecision(2) << bestMs << " ms"
+                     << "  nodes " << std::setw(8) << bvh.getNodes().size()
+                     << "  SAH cost " << std::setw(8) << bvh.computeSAHCost()
+                     << "  nodes/ray " << std::setw(6) << stats.nodeVisits / rayCount
+                     << "  triangles/ray " << std::setw(6) << stats.triangleTests / rayCount
+                     << "  duplication " << std::setprecision(3) << bvh.getDuplicationFactor());
+        }
+
+        benchmarkPrimitiveBounds(model);
+        benchmarkEdits(model, 100, 64);
+        benchmarkRayDistribution(model, modelBounds, 20000);
+
+        // single thread closest hit on the binned SAH tree, its wide collapses and their quantized copies
+        BVHBuilder bvh;
+        bvh.build(model);
+        WideBVH4 wide4;
+        wide4.build(bvh);
+        WideBVH8 wide8;
+        wide8.build(bvh);
+        QuantizedBVH16 quantized16;
+        quantized16.build(wide4);
+        QuantizedBVH8 quantized8;
+        quantized8.build(wide4);
+        DepthFirstBVH depthFirst;
+        depthFirst.build(bvh);
+        SkipBVH skip;
+        skip.build(bvh);
+
+        benchmarkRayStreams(bvh, model, modelBounds, 8);
+
+        auto nodeBytes = [](auto const& nodes) { return nodes.size() * sizeof(nodes[0]); };
+
+        constexpr int rayCount = 200000;
+        std::vector<Ray> rays = generateRays(bvh.getNodes()[0].aabb, rayCount);
+        benchmarkTraversal("binary", nodeBytes(bvh.getNodes()), rays, [&](Ray& ray, RayHit& hit, TraversalStats& stats) {
+            BVHTraversal::intersect(bvh, model, ray, hit, &stats);
+        });
+        // the same rays as occlusion queries, they stop at the first hit instead of searching for the closest one
+        benchmarkTraversal("occlusion", nodeBytes(bvh.getNodes()), rays, [&](Ray& ray, RayHit&, TraversalStats& stats) {
+            BVHTraversal::occluded(bvh, model, ray, &stats);
+        });
+        benchmarkTraversal("depth-first", nodeBytes(depthFirst.getNodes()), rays, [&](Ray& ray, RayHit& hit, TraversalStats& stats) {
+            depthFirst.intersect(model, ray, hit, &stats);
+        });
+        benchmarkTraversal("wide 4", nodeBytes(wide4.getNodes()), rays, [&](Ray& ray, RayHit& hit, TraversalStats& stats) {
+            wide4.intersect(model, ray, hit, &stats);
+        });
+        benchmarkTraversal("wide 8", nodeBytes(wide8.getNodes()), rays, [&](Ray& ray, RayHit& hit, TraversalStats& stats) {
+            wide8.intersect(model, ray, hit, &stats);
+        });
+        benchmarkTraversal("wide 4 q16", nodeBytes(quantized16.getNodes()), rays, [&](Ray& ray, RayHit& hit, TraversalStats& stats) {
+            quantized16.intersect(model, ray, hit, &stats);
+        });
+        benchmarkTraversal("wide 4 q8", nodeBytes(quantized8.getNodes()), rays, [&](Ray& ray, RayHit& hit, TraversalStats& stats) {
+            quantized8.intersect(model, ray, hit, &stats);
+        });
+        benchmarkTraversal("skip links", nodeBytes(skip.getNodes()), rays, [&](Ray& ray, RayHit& hit, TraversalStats& stats) {
+            skip.intersect(model, ray, hit, &stats);
+        });
+
+        // the same tree as the only instance of a two-level scene, cost of the extra level and ray transform
+        TwoLevelBVH instanced;
+        instanced.addInstance(instanced.addMesh(model, bvh), glm::mat4(1.0f));
+        instanced.build();
+        benchmarkTraversal("instanced", nodeBytes(bvh.getNodes()) + nodeBytes(instanced.getTopLevel().getNodes()), rays,
+            [&](Ray& ray, RayHit& hit, TraversalStats& stats) {
+                instanced.intersect(ray, hit, &stats);
+            });
+
+        // the same tree in scheduling order, in preorder and clustered into treelets, 128 byte lines of 4 x 2 texels
+        BVHBuildSettings preorderSettings;
+        preorderSettings.deterministic = true;
+        BVHBuilder preorder(preorderSettings);
+        preorder.build(model);
+        ClusteredBVH clustered;
+        clustered.build(bvh);
+        const int tileWidth = clustered.getSettings().tileWidth;
+        const int tileHeight = clustered.getSettings().tileHeight;
+        const int vertexCount = model.vertices.size();
+
+        std::vector<Ray> cacheRays(rays.begin(), rays.begin() + rayCount / 10);
+        benchmarkTexelCache("build order", bvh.getNodes(), bvh.getTriangleIndices(), model,
+            texturePlacement(bvh.getNodes().size(), bvh.getTriangleIndices().size(), vertexCount), cacheRays);
+        benchmarkTexelCache("depth-first", preorder.getNodes(), preorder.getTriangleIndices(), model,
+            texturePlacement(preorder.getNodes().size(), preorder.getTriangleIndices().size(), vertexCount), cacheRays);
+        benchmarkTexelCache("clustered rows", clustered.getNodes(), clustered.getTriangleIndices(), model,
+            texturePlacement(clustered.getNodes().size(), clustered.getTriangleIndices().size(), vertexCount), cacheRays);
+        benchmarkTexelCache("clustered tiles", clustered.getNodes(), clustered.getTriangleIndices(), model,
+            texturePlacement(clustered.getNodes().size(), clustered.getTriangleIndices().size(), vertexCount, tileWidth, tileHeight), cacheRays);
+    }
+    return 0;
+}
@@ -0,0 +1,186 @@
+// Headless BVH quality report of one model and builder configuration, JSON on stdout.
+// usage: BVHInspect model.obj [--split midpoint|sah|lbvh|sbvh|ploc] [--bins N] [--leaf-size N] [--morton-bits 30|63]
+//                   [--split-budget F] [--ploc-radius N] [--threads N] [--deterministic] [--optimize]
+// model path is relative to resource dir
+
+#include "BVHBuilder.h"
+#include "BVHMetrics.h"
+#include "BVHOptimizer.h"
+#include "ModelLoader.h"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct SplitMethodName {
+    const char* name;
+    BVHSplitMethod method;
+};
+
+constexpr SplitMethodName splitMethodNames[] = {
+    { "midpoint", BVHSplitMethod::Midpoint },
+    { "sah", BVHSplitMethod::BinnedSAH },
+    { "lbvh", BVHSplitMethod::LBVH },
+    { "sbvh", BVHSplitMethod::SBVH },
+    { "ploc", BVHSplitMethod::PLOC },
+};
+
+const char* splitMethodName(BVHSplitMethod method)
+{
+    for (SplitMethodName const& entry : splitMethodNames) {
+        if (entry.method == method)
+            return entry.name;
+    }
+    return "unknown";
+}
+
+bool parseSplitMethod(std::string const& name, BVHSplitMethod& method)
+{
+    for (SplitMethodName const& entry : splitMethodNames) {
+        if (name == entry.name) {
+            method = entry.method;
+            return true;
+        }
+    }
+    return false;
+}
+
+// quoted and escaped, for paths with backslashes
+void writeString(std::ostream& out, std::string const& value)
+{
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\')
+            out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+void writeHistogram(std::ostream& out, std::vector<int> const& histogram)
+{
+    out << "[";
+    for (size_t i = 0; i < histogram.size(); ++i)
+        out << (i ? ", " : "") << histogram[i];
+    out << "]";
+}
+
+int usage()
+{
+    std::cerr << "usage: BVHInspect model.obj [--split midpoint|sah|lbvh|sbvh|ploc] [--bins N] [--leaf-size N] [--morton-bits 30|63]\n"
+                 "                  [--split-budget F] [--ploc-radius N] [--threads N] [--deterministic] [--optimize]"
+              << std::endl;
+    return 1;
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::string modelPath;
+    BVHBuildSettings settings;
+    bool optimize = false;
+
+    // std::stoi and std::stof throw on malformed numbers
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (option == "--split" && hasValue) {
+                if (!parseSplitMethod(argv[++i], settings.splitMethod))
+                    return usage();
+            } else if (option == "--bins" && hasValue) {
+                settings.sahBinCount = std::stoi(argv[++i]);
+            } else if (option == "--leaf-size" && hasValue) {
+                settings.maxLeafSize = std::stoi(argv[++i]);
+            } else if (option == "--morton-bits" && hasValue) {
+                settings.mortonBits = std::stoi(argv[++i]);
+            } else if (option == "--split-budget" && hasValue) {
+                settings.spatialSplitBudget = std::stof(argv[++i]);
+            } else if (option == "--ploc-radius" && hasValue) {
+                settings.plocRadius = std::stoi(argv[++i]);
+            } else if (option == "--threads" && hasValue) {
+                settings.threadCount = std::stoi(argv[++i]);
+            } else if (option == "--deterministic") {
+                settings.deterministic = true;
+            } else if (option == "--optimize") {
+                optimize = true;
+            } else if (option.rfind("--", 0) != 0 && modelPath.empty()) {
+                modelPath = option;
+            } else {
+                return usage();
+            }
+        }
+    } catch (std::logic_error const&) {
+        return usage();
+    }
+    if (modelPath.empty())
+        return usage();
+
+    std::vector<float> vertex, normal, uv;
+    ModelLoader::Obj(modelPath, vertex, normal, uv);
+    Model3D model = ModelLoader::toSingleMeshArray(vertex, normal, uv);
+    if (model.triangles.empty()) {
+        std::cerr << "No triangles in " << modelPath << std::endl;
+        return 1;
+    }
+
+    BVHBuilder bvh(settings);
+    bvh.build(model);
+    BVHBuildTimings timings = bvh.getBuildTimings();
+
+    BVHOptimizeReport optimizeReport;
+    if (optimize)
+        optimizeReport = BVHOptimizer().optimize(bvh);
+
+    const BVHMetrics metrics = BVHMetrics::compute(bvh);
+
+    std::ostream& out = std::cout;
+    out << "{\n";
+    out << "  \"model\": ";
+    writeString(out, modelPath);
+    out << ",\n";
+    out << "  \"triangles\": " << model.triangles.size() << ",\n";
+    out << "  \"settings\": {\"split\": \"" << splitMethodName(settings.splitMethod) << "\""
+        << ", \"bins\": " << settings.sahBinCount
+        << ", \"maxLeafSize\": " << settings.maxLeafSize
+        << ", \"mortonBits\": " << settings.mortonBits
+        << ", \"spatialSplitBudget\": " << settings.spatialSplitBudget
+        << ", \"plocRadius\": " << settings.plocRadius
+        << ", \"threads\": " << settings.threadCount
+        << ", \"deterministic\": " << (settings.deterministic ? "true" : "false")
+        << ", \"optimize\": " << (optimize ? "true" : "false") << "},\n";
+    out << "  \"buildMs\": {\"bounds\": " << timings.bounds
+        << ", \"sort\": " << timings.sort
+        << ", \"hierarchy\": " << timings.hierarchy
+        << ", \"reorder\": " << timings.reorder
+        << ", \"optimize\": " << optimizeReport.milliseconds
+        << ", \"total\": " << timings.total + optimizeReport.milliseconds << "},\n";
+    if (optimize) {
+        out << "  \"optimizer\": {\"costBefore\": " << optimizeReport.costBefore
+            << ", \"costAfter\": " << optimizeReport.costAfter
+            << ", \"passes\": " << optimizeReport.passes
+            << ", \"restructuredTreelets\": " << optimizeReport.restructuredTreelets << "},\n";
+    }
+    out << "  \"sahCost\": " << metrics.sahCost << ",\n";
+    out << "  \"nodes\": " << metrics.nodeCount << ",\n";
+    out << "  \"innerNodes\": " << metrics.innerCount << ",\n";
+    out << "  \"leaves\": " << metrics.leafCount << ",\n";
+    out << "  \"references\": " << metrics.referenceCount << ",\n";
+    out << "  \"duplicationFactor\": " << bvh.getDuplicationFactor() << ",\n";
+    out << "  \"maxDepth\": " << metrics.maxDepth << ",\n";
+    out << "  \"averageLeafDepth\": " << metrics.averageLeafDepth << ",\n";
+    out << "  \"depthHistogram\": ";
+    writeHistogram(out, metrics.depthHistogram);
+    out << ",\n  \"leafSizeHistogram\": ";
+    writeHistogram(out, metrics.leafSizeHistogram);
+    out << ",\n";
+    out << "  \"stack\": {\"required\": " << metrics.requiredStackSize
+        << ", \"shader\": " << BVHMetrics::shaderStackSize
+        << ", \"fits\": " << (metrics.fitsShaderStack() ? "true" : "false") << "},\n";
+    out << "  \"siblingOverlap\": " << metrics.siblingOverlap << ",\n";
+    out << "  \"overlappingSiblingRatio\": " << metrics.overlappingSiblingRatio << "\n";
+    out << "}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Headless CPU render of one model with the normal shading of raytracing.frag, PPM image on disk.
+// usage: BVHRender model.obj [--out image.ppm] [--size W H] [--camera X Y Z] [--yaw DEG] [--pitch DEG]
+//                  [--tile N] [--threads N] [--packet 4|8|16]
+// model path is relative to resource dir, the default camera is the start view of the viewer
+
+#include "BVHBuilder.h"
+#include "CpuRenderer.h"
+#include "ModelLoader.h"
+#include <gtc/matrix_transform.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define LOG(x) std::cout << x << std::endl
+
+namespace {
+int usage()
+{
+    std::cerr << "usage: BVHRender model.obj [--out image.ppm] [--size W H] [--camera X Y Z] [--yaw DEG] [--pitch DEG]\n"
+                 "                 [--tile N] [--threads N] [--packet 4|8|16]"
+              << std::endl;
+    return 1;
+}
+
+// FPS camera of the viewer, see updateMatrix() in main.cpp
+glm::mat3 viewToWorld(float yaw, float pitch)
+{
+    glm::mat4 matPitch = glm::rotate(glm::mat4(1.0f), glm::radians(pitch), glm::vec3(1, 0, 0));
+    glm::mat4 matYaw = glm::rotate(glm::mat4(1.0f), glm::radians(yaw), glm::vec3(0, 1, 0));
+    return glm::mat3(matYaw * matPitch);
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::string modelPath;
+    std::string outPath = "render.ppm";
+    CpuRenderSettings settings;
+    BVHBuildSettings buildSettings;
+    glm::vec3 location(11, 0.01, -0.501);
+    float yaw = -90.0f;
+    float pitch = 0.0f;
+
+    // std::stoi and std::stof throw on malformed numbers
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            auto hasValues = [&](int count) { return i + count < argc; };
+
+            if (option == "--out" && hasValues(1)) {
+                outPath = argv[++i];
+            } else if (option == "--size" && hasValues(2)) {
+                settings.width = std::stoi(argv[++i]);
+                settings.height = std::stoi(argv[++i]);
+            } else if (option == "--camera" && hasValues(3)) {
+                for (int a = 0; a < 3; ++a)
+                    location[a] = std::stof(argv[++i]);
+            } else if (option == "--yaw" && hasValues(1)) {
+                yaw = std::stof(argv[++i]);
+            } else if (option == "--pitch" && hasValues(1)) {
+                pitch = std::stof(argv[++i]);
+            } else if (option == "--tile" && hasValues(1)) {
+                settings.tileSize = std::stoi(argv[++i]);
+            } else if (option == "--threads" && hasValues(1)) {
+                settings.threadCount = std::stoi(argv[++i]);
+                buildSettings.threadCount = settings.threadCount;
+            } else if (option == "--packet" && hasValues(1)) {
+                settings.packetWidth = std::stoi(argv[++i]);
+            } else if (option.rfind("--", 0) != 0 && modelPath.empty()) {
+                modelPath = option;
+            } else {
+                return usage();
+            }
+        }
+    } catch (std::logic_error const&) {
+        return usage();
+    }
+    if (modelPath.empty() || settings.width <= 0 || settings.height <= 0)
+        return usage();
+
+    std::vector<float> vertex, normal, uv;
+    ModelLoader::Obj(modelPath, vertex, normal, uv);
+    Model3D model = ModelLoader::toSingleMeshArray(vertex, normal, uv);
+    if (model.triangles.empty()) {
+        std::cerr << "No triangles in " << modelPath << std::endl;
+        return 1;
+    }
+
+    BVHBuilder bvh(buildSettings);
+    bvh.build(model);
+
+    CpuRenderer renderer(settings);
+    renderer.render(bvh, model, location, viewToWorld(yaw, pitch));
+
+    const double rayCount = double(settings.width) * settings.height;
+    const TraversalStats& stats = renderer.getStats();
+    LOG(modelPath << ": " << model.triangles.size() << " triangles, BVH " << bvh.getBuildTimings().total << " ms");
+    if (renderer.getPacketWidth() > 0) {
+        const double packetCount = rayCount / renderer.getPacketWidth();
+        LOG(settings.width << "x" << settings.height << " in " << renderer.getMilliseconds() << " ms, "
+                           << rayCount / renderer.getMilliseconds() * 1e-3 << " Mrays/s"
+                           << ", packets of " << renderer.getPacketWidth()
+                           << ", nodes/packet " << stats.nodeVisits / packetCount);
+    } else {
+        LOG(settings.width << "x" << settings.height << " in " << renderer.getMilliseconds() << " ms, "
+                           << rayCount / renderer.getMilliseconds() * 1e-3 << " Mrays/s"
+                           << ", nodes/ray " << stats.nodeVisits / rayCount
+                           << ", triangles/ray " << stats.triangleTests / rayCount);
+    }
+
+    if (!renderer.writePPM(outPath)) {
+        std::cerr << "Failed to write " << outPath << std::endl;
+        return 1;
+    }
+    LOG("Written " << outPath);
+    return 0;
+}